@@ -18,18 +18,82 @@
   #define ECB 1
 #endif
 
+// AES_TTABLE selects how Cipher/InvCipher compute a round:
+// 0: byte-wise SubBytes/ShiftRows/MixColumns with xtime (smallest ROM).
+// 1: one 1KB table per direction, rotated at run-time (MSP430: sky, z1).
+// 2: four 1KB tables per direction (32-bit targets: CC2538, native).
+#ifndef AES_TTABLE
+  #define AES_TTABLE 1
+#endif
+
+// The tables hold a state column as a little-endian word.
+#if AES_TTABLE && defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+  #undef AES_TTABLE
+  #define AES_TTABLE 0
+#endif
+
+// AES_BATCH adds the *_batch calls below: many blocks, each with its own key, per call.
+// On x86 they run on AES-NI when the CPU has it (checked at run time), on the rounds
+// above otherwise. They are meant for the gateway host, the nodes do not need them.
+#ifndef AES_BATCH
+  #if defined(__x86_64__) || defined(__i386__)
+    #define AES_BATCH 1
+  #else
+    #define AES_BATCH 0
+  #endif
+#endif
+
+
+// Key schedule and CBC chaining value of one key. Expand a key once with AES128_init_ctx()
+// and keep the context for as long as the key is in use; contexts share no state, so
+// several keys can be active at the same time.
+typedef struct
+{
+  uint8_t Key[16];            // the key the schedule was expanded from
+  union
+  {
+    uint8_t  b[176];
+    uint32_t w[44];           // one word per state column, used by the T-table rounds
+  } RoundKey;
+#if AES_TTABLE
+  uint32_t InvRoundKey[44];   // equivalent inverse cipher, used by InvCipher
+#endif
+  uint8_t Iv[16];             // CBC chaining value, advanced by the *_buffer_ctx calls
+} aes128_ctx;
+
+void AES128_init_ctx(aes128_ctx* ctx, const uint8_t* key);
+void AES128_ctx_set_iv(aes128_ctx* ctx, const uint8_t* iv);
+
 
 
 #if defined(ECB) && ECB
 
+// In-place single block with an expanded key.
+void AES128_ECB_encrypt_ctx(const aes128_ctx* ctx, uint8_t* buf);
+void AES128_ECB_decrypt_ctx(const aes128_ctx* ctx, uint8_t* buf);
+
+// Expand key on every call.
 void AES128_ECB_encrypt(uint8_t* input, const uint8_t* key, uint8_t *output);
 void AES128_ECB_decrypt(uint8_t* input, const uint8_t* key, uint8_t *output);
 
+#if AES_BATCH
+
+// In place: block blk[i] with key schedule ctx[i], for i < n. Entries of ctx may repeat.
+void AES128_ECB_encrypt_batch(const aes128_ctx* const* ctx, uint8_t* const* blk, uint32_t n);
+void AES128_ECB_decrypt_batch(const aes128_ctx* const* ctx, uint8_t* const* blk, uint32_t n);
+
+#endif // #if AES_BATCH
+
 #endif // #if defined(ECB) && ECB
 
 
 #if defined(CBC) && CBC
 
+// Chain from ctx->Iv; output may be equal to input.
+void AES128_CBC_encrypt_buffer_ctx(aes128_ctx* ctx, uint8_t* output, const uint8_t* input, uint32_t length);
+void AES128_CBC_decrypt_buffer_ctx(aes128_ctx* ctx, uint8_t* output, const uint8_t* input, uint32_t length);
+
+// Expand key (unless 0) and load iv (unless 0) on every call.
 void AES128_CBC_encrypt_buffer(uint8_t* output, uint8_t* input, uint32_t length, const uint8_t* key, const uint8_t* iv);
 void AES128_CBC_decrypt_buffer(uint8_t* output, uint8_t* input, uint32_t length, const uint8_t* key, const uint8_t* iv);
 
@@ -0,0 +1,75 @@
+/*
+|-------------------------------------------------------------------|
+| HCMC University of Technology                                     |
+| Telecommunications Departments                                    |
+| Wireless Embedded Firmware for Smart Lighting System (SLS)        |
+| Version: 2.0                                                      |
+| Author: sonvq@hcmut.edu.vn                                        |
+| Date: 01/2019                                                     |
+| HW support in ISM band: TelosB, CC2538, CC2530, CC1310, z1        |
+|-------------------------------------------------------------------|*/
+
+#include "contiki.h"
+#include "sys/ctimer.h"
+#include "dev/leds.h"
+
+#include "led_anim.h"
+
+#define LED_ANIM_MASK	(LED_ANIM_QUEUE_LEN - 1)
+
+typedef struct {
+	unsigned char	leds;
+	uint8_t			toggles;			/* left to do, 2 per blink */
+	clock_time_t	period;
+} led_pattern_t;
+
+static led_pattern_t	queue[LED_ANIM_QUEUE_LEN];
+static uint8_t			head, tail;			/* free running, queue[tail] is playing */
+static struct ctimer	led_ct;
+
+/*---------------------------------------------------------------------------*/
+void led_anim_init(void) {
+	ctimer_stop(&led_ct);
+	head = tail = 0;
+}
+
+/*---------------------------------------------------------------------------*/
+// one step of the current pattern, runs from the ctimer
+static void led_step(void *ptr) {
+	led_pattern_t *p = &queue[tail & LED_ANIM_MASK];
+
+	leds_toggle(p->leds);
+	if (--p->toggles == 0) {
+		tail++;
+		if (head == tail) {
+			return;
+		}
+		p = &queue[tail & LED_ANIM_MASK];
+	}
+	ctimer_set(&led_ct, p->period, led_step, NULL);
+}
+
+/*---------------------------------------------------------------------------*/
+void led_blink(unsigned char leds, uint8_t n, clock_time_t period) {
+	led_pattern_t *last = &queue[(head - 1) & LED_ANIM_MASK];
+
+	if ((n == 0) || (n > 127)) {
+		return;
+	}
+	/* the same pattern is already waiting: a burst of packets gives one signal */
+	if (((uint8_t)(head - tail) > 1) && (last->leds == leds) && (last->period == period)) {
+		return;
+	}
+	if ((uint8_t)(head - tail) == LED_ANIM_QUEUE_LEN) {
+		return;
+	}
+	queue[head & LED_ANIM_MASK].leds = leds;
+	queue[head & LED_ANIM_MASK].toggles = 2*n;
+	queue[head & LED_ANIM_MASK].period = period;
+	head++;
+
+	/* idle: first toggle on the next tick, after the caller has set the steady LED state */
+	if ((uint8_t)(head - tail) == 1) {
+		ctimer_set(&led_ct, 0, led_step, NULL);
+	}
+}
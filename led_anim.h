@@ -0,0 +1,32 @@
+/*
+|-------------------------------------------------------------------|
+| HCMC University of Technology                                     |
+| Telecommunications Departments                                    |
+| Wireless Embedded Firmware for Smart Lighting System (SLS)        |
+| Version: 2.0                                                      |
+| Author: sonvq@hcmut.edu.vn                                        |
+| Date: 01/2019                                                     |
+| HW support in ISM band: TelosB, CC2538, CC2530, CC1310, z1        |
+|-------------------------------------------------------------------|*/
+
+/* Non-blocking LED signalling.
+   led_blink() queues a blink pattern and returns at once; the patterns are
+   played one after the other from a ctimer, so no caller waits on the LEDs. */
+
+#ifndef LED_ANIM_H_
+#define LED_ANIM_H_
+
+#include "contiki.h"
+
+#ifndef LED_ANIM_QUEUE_LEN
+#define LED_ANIM_QUEUE_LEN		4				/* pending patterns, power of 2 */
+#endif
+
+#define LED_BLINK_NUM			3				/* blinks of the packet signal */
+#define LED_BLINK_PERIOD		(CLOCK_SECOND/16)	/* on or off time of one blink */
+
+void	led_anim_init(void);
+/* blink leds n times, each blink on for period then off for period */
+void	led_blink(unsigned char leds, uint8_t n, clock_time_t period);
+
+#endif /* LED_ANIM_H_ */
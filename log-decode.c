@@ -0,0 +1,109 @@
+/*
+|-------------------------------------------------------------------|
+| HCMC University of Technology                                     |
+| Telecommunications Departments                                    |
+| Wireless Embedded Firmware for Smart Lighting System (SLS)        |
+| Version: 2.0                                                      |
+| Author: sonvq@hcmut.edu.vn                                        |
+| Date: 01/2019                                                     |
+| HW support in ISM band: TelosB, CC2538, CC2530, CC1310, z1        |
+|-------------------------------------------------------------------|
+
+Host tool: decodes the ":<hex>" record lines written by log_buf.c back into text,
+other lines are copied as they are.
+
+	make log-decode
+	./log-decode [-t] < serial.log		(-t: prefix each record with its clock tick)
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "log_buf.h"
+
+#define LOG_EV_FMT(id, lvl, fmt)	fmt,
+static const char *ev_fmt[LOG_EV_COUNT] = { LOG_EVENTS(LOG_EV_FMT) };
+
+/*---------------------------------------------------------------------------*/
+static int hex_val(char c) {
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	return -1;
+}
+
+/*---------------------------------------------------------------------------*/
+// printf of one record, the args are taken from the record payload
+static void print_record(const unsigned char *rec, int with_time) {
+	const char *f = ev_fmt[rec[0]];
+	const unsigned char *arg = rec + 4, *end = rec + 4 + rec[1];
+	char spec[16];
+	int k, v;
+
+	if (with_time)
+		printf("[%5u] ", rec[2] | (rec[3] << 8));
+	while (*f) {
+		if (*f != '%') {
+			putchar(*f++);
+			continue;
+		}
+		k = 0;
+		spec[k++] = *f++;
+		while ((*f != 0) && (strchr("0123456789-+ #", *f) != NULL) && (k < 12))
+			spec[k++] = *f++;
+		switch (*f) {
+			case 'H':
+			case 'h':
+				while (arg < end)
+					printf(*f=='H' ? "%02X" : "%02X ", *arg++);
+				break;
+			case 'd':
+			case 'u':
+			case 'x':
+			case 'X':
+				v = (arg + 1 < end) ? (arg[0] | (arg[1] << 8)) : 0;
+				arg += 2;
+				if (*f=='d')
+					v = (short)v;
+				spec[k++] = *f;
+				spec[k] = 0;
+				printf(spec, v);
+				break;
+			case '%':
+				putchar('%');
+				break;
+			default:
+				continue;
+		}
+		f++;
+	}
+	putchar('\n');
+}
+
+/*---------------------------------------------------------------------------*/
+int main(int argc, char *argv[]) {
+	char line[1024];
+	unsigned char rec[(sizeof(line) - 1) / 2];
+	int with_time = (argc > 1) && (strcmp(argv[1], "-t")==0);
+	int n, hi, lo;
+	char *p;
+
+	while (fgets(line, sizeof(line), stdin) != NULL) {
+		/* Cooja and serialdump may prefix the mote output, the record starts at LOG_SYNC */
+		p = strrchr(line, LOG_SYNC);
+		n = 0;
+		if (p != NULL) {
+			for (p++; ((hi = hex_val(p[0])) >= 0) && ((lo = hex_val(p[1])) >= 0); p += 2)
+				rec[n++] = (hi << 4) | lo;
+			while (isspace((unsigned char)*p))
+				p++;
+		}
+		if ((p == NULL) || (*p != 0) || (n < 4) || (n != 4 + rec[1]) || (rec[0] >= LOG_EV_COUNT)) {
+			fputs(line, stdout);
+			continue;
+		}
+		print_record(rec, with_time);
+	}
+	return 0;
+}
@@ -0,0 +1,129 @@
+/*
+|-------------------------------------------------------------------|
+| HCMC University of Technology                                     |
+| Telecommunications Departments                                    |
+| Wireless Embedded Firmware for Smart Lighting System (SLS)        |
+| Version: 2.0                                                      |
+| Author: sonvq@hcmut.edu.vn                                        |
+| Date: 01/2019                                                     |
+| HW support in ISM band: TelosB, CC2538, CC2530, CC1310, z1        |
+|-------------------------------------------------------------------|*/
+
+#include "contiki.h"
+#include <stdio.h>
+#include <string.h>
+
+#include "log_buf.h"
+
+#if (LOG_LEVEL > LOG_LEVEL_NONE)
+
+#define LOG_HDR_LEN		4			/* id, n, time */
+#define LOG_MASK		(LOG_BUF_SIZE - 1)
+
+static uint8_t 	ring[LOG_BUF_SIZE];
+static uint16_t head, tail;			/* free running, head - tail bytes in use */
+static uint16_t lost;
+
+PROCESS(log_drain_process, "SLS log drain");
+
+/*---------------------------------------------------------------------------*/
+void log_init(void) {
+	head = tail = lost = 0;
+	process_start(&log_drain_process, NULL);
+}
+
+/*---------------------------------------------------------------------------*/
+// reserve a record, 0 if the ring is full
+static uint8_t log_begin(uint8_t ev, uint8_t n) {
+	clock_time_t now;
+
+	if ((uint16_t)(LOG_BUF_SIZE - (head - tail)) < LOG_HDR_LEN + n) {
+		lost++;
+		return 0;
+	}
+	now = clock_time();
+	ring[head++ & LOG_MASK] = ev;
+	ring[head++ & LOG_MASK] = n;
+	ring[head++ & LOG_MASK] = now & 0xFF;
+	ring[head++ & LOG_MASK] = (now >> 8) & 0xFF;
+	return 1;
+}
+
+/*---------------------------------------------------------------------------*/
+void log_put(uint8_t ev, const uint16_t *args, uint8_t n) {
+	uint8_t i;
+
+	if (!log_begin(ev, 2*n))
+		return;
+	for (i=0; i<n; i++) {
+		ring[head++ & LOG_MASK] = args[i] & 0xFF;
+		ring[head++ & LOG_MASK] = args[i] >> 8;
+	}
+	process_poll(&log_drain_process);
+}
+
+/*---------------------------------------------------------------------------*/
+void log_put_hex(uint8_t ev, const void *data, uint8_t len) {
+	const uint8_t *p = data;
+
+	if (!log_begin(ev, len))
+		return;
+	while (len--) {
+		ring[head++ & LOG_MASK] = *p++;
+	}
+	process_poll(&log_drain_process);
+}
+
+/*---------------------------------------------------------------------------*/
+static void put_hex(uint8_t b) {
+	static const char hex[] = "0123456789ABCDEF";
+	putchar(hex[b >> 4]);
+	putchar(hex[b & 0x0F]);
+}
+
+/*---------------------------------------------------------------------------*/
+// write out the oldest record
+static void log_drain_one(void) {
+	uint8_t len = LOG_HDR_LEN + ring[(tail + 1) & LOG_MASK];
+
+	putchar(LOG_SYNC);
+	while (len--) {
+		put_hex(ring[tail++ & LOG_MASK]);
+	}
+	putchar('\n');
+}
+
+/*---------------------------------------------------------------------------*/
+// records go out only while no other event is waiting, one at a time
+PROCESS_THREAD(log_drain_process, ev, data) {
+	clock_time_t now;
+
+	PROCESS_BEGIN();
+	while(1) {
+		PROCESS_YIELD_UNTIL(ev == PROCESS_EVENT_POLL);
+		while (head != tail) {
+			if (process_nevents() > 0) {
+				process_poll(&log_drain_process);
+				break;
+			}
+			log_drain_one();
+		}
+		if ((head == tail) && (lost > 0)) {
+			now = clock_time();
+			putchar(LOG_SYNC);
+			put_hex(EV_LOG_LOST); put_hex(2);
+			put_hex(now & 0xFF); put_hex((now >> 8) & 0xFF);
+			put_hex(lost & 0xFF); put_hex(lost >> 8);
+			putchar('\n');
+			lost = 0;
+		}
+	}
+	PROCESS_END();
+}
+
+#else
+
+void log_init(void) {
+}
+
+#endif /* LOG_LEVEL */
@@ -0,0 +1,118 @@
+/*
+|-------------------------------------------------------------------|
+| HCMC University of Technology                                     |
+| Telecommunications Departments                                    |
+| Wireless Embedded Firmware for Smart Lighting System (SLS)        |
+| Version: 2.0                                                      |
+| Author: sonvq@hcmut.edu.vn                                        |
+| Date: 01/2019                                                     |
+| HW support in ISM band: TelosB, CC2538, CC2530, CC1310, z1        |
+|-------------------------------------------------------------------|*/
+
+/* Binary event log.
+   LOG(ev, args...) appends a record to a RAM ring instead of formatting text:
+   	id[1] | n[1] | time[2] | n bytes of args (16-bit little-endian each, or raw bytes for LOG_HEX)
+   The ring is written out by log_drain_process when the node is idle, one
+   ":<hex of the record>" line per record. log-decode.c turns the lines back into
+   the text below; other lines are passed through, so PRINTF output can be mixed in.
+   This header is shared with log-decode.c and must not depend on Contiki. */
+
+#ifndef LOG_BUF_H_
+#define LOG_BUF_H_
+
+#include <stdint.h>
+
+#define LOG_LEVEL_NONE		0
+#define LOG_LEVEL_ERR		1
+#define LOG_LEVEL_INFO		2
+#define LOG_LEVEL_DBG		3
+
+/* compile-time level (project-conf.h): events above it are compiled out, and
+   LOG_LEVEL_NONE removes the ring and the drain process as well */
+#ifndef LOG_LEVEL
+#define LOG_LEVEL			LOG_LEVEL_NONE
+#endif
+
+#ifndef LOG_BUF_SIZE
+#define LOG_BUF_SIZE		256			/* power of 2 */
+#endif
+
+#define LOG_SYNC			':'			/* first char of a drained record line */
+
+/* id, level, text for log-decode: %d %u %x %X (one 16-bit arg each, flags and width as printf),
+   %H / %h (the rest of the record as hex bytes, without / with a space after each) */
+#define LOG_EVENTS(X)	\
+	X(EV_LOG_LOST,		LOG_LEVEL_ERR,	"log: %u records lost")	\
+	X(EV_RX_PKT,		LOG_LEVEL_INFO,	"\n In state = %u, received a packet (%u byte) from [..:%x:%x]:%u")	\
+	X(EV_RX_SHORT,		LOG_LEVEL_ERR,	" - Packet too short: %u bytes")	\
+	X(EV_RX_ENCRYPTED,	LOG_LEVEL_DBG,	" - Maybe received packate is encrypted: SPF = 0x%02X")	\
+	X(EV_RX_CLEAR,		LOG_LEVEL_DBG,	" - Received packate is NOT encrypted")	\
+	X(EV_RX_DECRYPT_OFF,LOG_LEVEL_DBG,	" - Decryption:... DISABLED")	\
+	X(EV_RX_BAD_COMPACT,LOG_LEVEL_ERR,	" - Bad compact frame (%u bytes)")	\
+	X(EV_RX_BAD_MIC,	LOG_LEVEL_ERR,	" - Bad MIC")	\
+	X(EV_RX_BAD_CRC,	LOG_LEVEL_ERR,	" - Bad CRC")	\
+	X(EV_PEER_NEW,		LOG_LEVEL_INFO,	" - new peer [..:%x:%x] in slot %u")	\
+	X(EV_RX_DROP,		LOG_LEVEL_ERR,	" - Drop packet")	\
+	X(EV_RX_CMD,		LOG_LEVEL_INFO,	" - Rx CMD-struct: sfd=0x%02X; len=%u; seq=%u; type=0x%02X; cmd=0x%02X; err_code=0x%04X")	\
+	X(EV_RX_DATA,		LOG_LEVEL_DBG,	" - Data = [%H]")	\
+	X(EV_RX_SEQ,		LOG_LEVEL_DBG,	" - [new_seq/old_seq] = [%u/%u]")	\
+	X(EV_RX_CACHED,		LOG_LEVEL_INFO,	" - seq %u repeated: cached reply sent")	\
+	X(EV_RX_REPLAY,		LOG_LEVEL_INFO,	" - seq %u already executed or too old: not executed")	\
+	X(EV_GROUP_RX,		LOG_LEVEL_INFO,	" - group msg [%u], CMD = 0x%02X: no reply")	\
+	X(EV_GROUP_SKIP,	LOG_LEVEL_DBG,	" - not for groups 0x%04X: skipped")	\
+	X(EV_RADIO,			LOG_LEVEL_DBG,	" - CH = %u, RSSI = %d dBm, LQI = %u, Tx Power = %d dBm")	\
+	X(EV_RSSI_SENT,		LOG_LEVEL_DBG,	" - rssi_sent = %d")	\
+	X(EV_REQ,			LOG_LEVEL_INFO,	"Process REQ ....")	\
+	X(EV_BUNDLE,		LOG_LEVEL_INFO,	"Process BUNDLE: %u commands, err_code = 0x%02X")	\
+	X(EV_EXEC,			LOG_LEVEL_DBG,	" - Execute CMD = 0x%02X")	\
+	X(EV_EXEC_DIM,		LOG_LEVEL_DBG,	" - Execute CMD = 0x%02X; value = %u")	\
+	X(EV_CHALLENGE,		LOG_LEVEL_INFO,	" - challenge_code = 0x%04X, challenge_res  = 0x%04X")	\
+	X(EV_APP_KEY,		LOG_LEVEL_INFO,	"In state = %u, got the APP_KEY: authenticated")	\
+	X(EV_KEY,			LOG_LEVEL_DBG,	" - Key = [%h]")	\
+	X(EV_GROUP_KEY,		LOG_LEVEL_INFO,	"Got the group key")	\
+	X(EV_GROUP_SET,		LOG_LEVEL_INFO,	"Member of groups 0x%04X")	\
+	X(EV_APP_ID,		LOG_LEVEL_INFO,	" - encryption_phase =  %u; My APP-ID = %u")	\
+	X(EV_REPLY_NW,		LOG_LEVEL_DBG,	"\nReply for NW command: ")	\
+	X(EV_REPLY_LED,		LOG_LEVEL_DBG,	"\nReply for LED-driver command: ")	\
+	X(EV_TX_PLAIN,		LOG_LEVEL_DBG,	" - Encryption:... DISABLED")	\
+	X(EV_TX_REPLY,		LOG_LEVEL_INFO,	"Reply a msg (%u bytes) to [..:%x:%x]:%u")	\
+	X(EV_ASYNC_DELAY,	LOG_LEVEL_DBG,	" - Delay a random time = %u ms")	\
+	X(EV_ASYNC_TX,		LOG_LEVEL_INFO,	"Client sending (%u bytes) ASYNC msg [%u], CMD = 0x%02X, to BR\n")	\
+	X(EV_ASYNC_NOAUTH,	LOG_LEVEL_ERR,	"Failed to send ASYNC msg [%u]: Route to BR found but unauthenticated...")	\
+	X(EV_ASYNC_NOROUTE,	LOG_LEVEL_ERR,	"Failed to send ASYNC msg: No route to BR found...")	\
+	X(EV_TELEMETRY,		LOG_LEVEL_INFO,	"Telemetry: %u msgs sent, %u readings within the deadbands not sent")	\
+	X(EV_TELEMETRY_SKIP,LOG_LEVEL_DBG,	" - readings within the deadbands, %u s since the last msg")	\
+	X(EV_ASYNC_FULL,	LOG_LEVEL_ERR,	"ASYNC queue full: msg CMD = 0x%02X dropped")	\
+	X(EV_ASYNC_ACK,		LOG_LEVEL_INFO,	"ASYNC msg [%u] acked after %u transmissions")	\
+	X(EV_ASYNC_GIVEUP,	LOG_LEVEL_ERR,	"ASYNC msg [%u], CMD = 0x%02X: no ACK, dropped")	\
+	X(EV_CRC_GEN,		LOG_LEVEL_DBG,	" - Generate CRC16 [0x%04X]... done ")	\
+	X(EV_CRC_OK,		LOG_LEVEL_DBG,	"CRC16...matched")	\
+	X(EV_CRC_FAIL,		LOG_LEVEL_ERR,	"CRC16 ...failed: CRC-cal = 0x%04X; CRC-val =  0x%04X  ")	\
+	X(EV_HW_KEY_FAIL,	LOG_LEVEL_ERR,	" - HW AES: loading key failed ")	\
+	X(EV_SCRAMBLE,		LOG_LEVEL_DBG,	" - Scramble data ... done ")	\
+	X(EV_DESCRAMBLE,	LOG_LEVEL_DBG,	" - Descramble data ... done ")	\
+	X(EV_ENC_CBC,		LOG_LEVEL_DBG,	" - Encrypt AES128-CBC ... done ")	\
+	X(EV_DEC_CBC,		LOG_LEVEL_DBG,	" - Decrypt AES128-CBC ... done ")	\
+	X(EV_ENC_CCM,		LOG_LEVEL_DBG,	" - Encrypt AES128-CCM ... done ")	\
+	X(EV_DEC_CCM,		LOG_LEVEL_DBG,	" - Decrypt AES128-CCM ... done ")	\
+	X(EV_DEC_CCM_FAIL,	LOG_LEVEL_ERR,	" - Decrypt AES128-CCM ... MIC failed ")
+
+#define LOG_EV_ID(id, lvl, fmt)		id,
+#define LOG_EV_LVL(id, lvl, fmt)	id##_LVL = lvl,
+
+enum { LOG_EVENTS(LOG_EV_ID) LOG_EV_COUNT };
+enum { LOG_EVENTS(LOG_EV_LVL) };
+
+#define LOG_ON(ev)			((ev##_LVL) <= LOG_LEVEL)
+
+/* process context only; when ev is compiled out the arguments are not evaluated */
+#define LOG0(ev)			do { if (LOG_ON(ev)) log_put(ev, 0, 0); } while (0)
+#define LOG(ev, ...)		do { if (LOG_ON(ev)) { const uint16_t log_a_[] = {__VA_ARGS__}; \
+								log_put(ev, log_a_, sizeof(log_a_)/sizeof(uint16_t)); } } while (0)
+#define LOG_HEX(ev, p, n)	do { if (LOG_ON(ev)) log_put_hex(ev, (p), (n)); } while (0)
+
+void	log_init(void);
+void	log_put(uint8_t ev, const uint16_t *args, uint8_t n);
+void	log_put_hex(uint8_t ev, const void *data, uint8_t len);
+
+#endif /* LOG_BUF_H_ */
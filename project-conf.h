@@ -64,15 +64,28 @@
 
 
 
+/* Low-power profile (make LOW_POWER=1) for battery-backed and meter nodes:
+   ContikiMAC duty-cycles the radio, LPM is enabled, and the LED heartbeat is off so
+   the node sleeps until the next scheduled task (sched.c). The default profile keeps
+   the radio on (nullrdc) for mains-powered lamps. All nodes of a PAN, the border
+   router included, must run the same RDC. */
+#ifndef SLS_LOW_POWER
+#define SLS_LOW_POWER				0
+#endif
+
 /* define RDC and MAC here */
 #undef 	NETSTACK_CONF_MAC
 #define NETSTACK_CONF_MAC     	csma_driver			// nullmac_driver, csma_driver
 
 #undef 	NETSTACK_CONF_RDC
+#if SLS_LOW_POWER
+#define NETSTACK_CONF_RDC     	contikimac_driver
+#define NETSTACK_CONF_RDC_CHANNEL_CHECK_RATE 	8		/* Hz: radio on ~0.6% when idle */
+#define LED_HEARTBEAT_PERIOD	0
+#else
 #define NETSTACK_CONF_RDC     	nullrdc_driver 	//nullrdc_driver, cxmac_driver, contikimac_driver
-
-
 #define NETSTACK_CONF_RDC_CHANNEL_CHECK_RATE 	64
+#endif /* SLS_LOW_POWER */
 
 #undef 	NULLRDC_CONF_802154_AUTOACK
 #define NULLRDC_CONF_802154_AUTOACK       1
@@ -98,9 +111,35 @@
 #define UIP_CONF_IP_FORWARD         0
 
 
-/* Low Power Mode */
+/* IPv6 multicast for the group commands (SLS_MULTICAST_PORT): ROLL-TM (Trickle),
+   independent of the RPL mode of operation; SMRF would need RPL storing mode with
+   multicast. The border router must be built with the same engine.
+   Opt-in (make MULTICAST=1), on by default only on cc2538dk: ROLL-TM and its buffers
+   do not fit next to the rest on the 10 KB RAM of sky/z1. */
+#ifndef SLS_MULTICAST
+#define SLS_MULTICAST				0
+#endif
+
+#if SLS_MULTICAST
+#include "net/ipv6/multicast/uip-mcast6-engines.h"
+#define UIP_MCAST6_CONF_ENGINE		UIP_MCAST6_ENGINE_ROLL_TM
+#if SLS_LOW_POWER
+#define ROLL_TM_CONF_IMIN_1			64		/* ms: 16 over nullrdc, 64 over ContikiMAC */
+#else
+#define ROLL_TM_CONF_IMIN_1			16
+#endif
+#define ROLL_TM_CONF_BUFF_NUM		2		/* group msgs cached for forwarding */
+#define UIP_MCAST6_ROUTE_CONF_ROUTES	1
+#endif /* SLS_MULTICAST */
+
+
+/* Low Power Mode (CC2538; MSP430 targets always sleep in LPM3 when idle) */
+#if SLS_LOW_POWER
+#define LPM_CONF_ENABLE       		1
+#else
 #define LPM_CONF_ENABLE       		0		/**< Set to 0 to disable LPM entirely */
-#define LPM_CONF_MAX_PM       		1
+#endif
+#define LPM_CONF_MAX_PM       		1		/* PM2 would lose the upper 16KB of RAM */
 
 
 //if using CC2592 PA, set this to TRUE
@@ -118,6 +157,16 @@
 #define DEBUG 	1					//	DEBUG_NONE=0;	 DEBUG_PRINT=1
 //#endif
 
+/* binary log of the packet path, see log_buf.h: decode with log-decode
+   LOG_LEVEL_NONE=0 (production), ERR=1, INFO=2, DBG=3 */
+#ifndef LOG_LEVEL
+#if SLS_LOW_POWER
+#define LOG_LEVEL	1				/* every record is a wake-up of the UART */
+#else
+#define LOG_LEVEL	3
+#endif
+#endif
+
 #ifndef STARTUP_CONF_VERBOSE
 #define STARTUP_CONF_VERBOSE        1 /**< Set to 0 to decrease startup verbosity */
 #endif
@@ -142,8 +191,9 @@
 
 
 #if (SECURITY_EN)
-/* software-based AES */
-#if (!SLS_USING_HW)
+/* software-based AES, except on CC2538 where the platform default cc2538_aes_128_driver
+   uses the crypto engine (SLS_USING_HW is defined in sls.h, not visible here) */
+#ifndef CONTIKI_TARGET_CC2538DK
 #undef AES_128_CONF    
 #define AES_128_CONF 	aes_128_driver
 #endif 
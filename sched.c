@@ -0,0 +1,90 @@
+/*
+|-------------------------------------------------------------------|
+| HCMC University of Technology                                     |
+| Telecommunications Departments                                    |
+| Wireless Embedded Firmware for Smart Lighting System (SLS)        |
+| Version: 2.0                                                      |
+| Author: sonvq@hcmut.edu.vn                                        |
+| Date: 01/2019                                                     |
+| HW support in ISM band: TelosB, CC2538, CC2530, CC1310, z1        |
+|-------------------------------------------------------------------|*/
+
+#include "contiki.h"
+#include "sys/ctimer.h"
+
+#include "sched.h"
+
+static sched_task_t		*tasks;
+static struct ctimer	sched_ct;
+
+static void sched_run(void *ptr);
+
+/*---------------------------------------------------------------------------*/
+void sched_init(void) {
+	ctimer_stop(&sched_ct);
+	tasks = NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+// timer to the nearest deadline, none without tasks
+static void sched_arm(void) {
+	sched_task_t *t;
+	clock_time_t now = clock_time(), elapsed, left, next = 0;
+
+	for (t = tasks; t != NULL; t = t->next) {
+		elapsed = now - t->start;
+		left = (elapsed >= t->period) ? 0 : t->period - elapsed;
+		if ((t == tasks) || (left < next)) {
+			next = left;
+		}
+	}
+	if (tasks != NULL) {
+		ctimer_set(&sched_ct, next, sched_run, NULL);
+	} else {
+		ctimer_stop(&sched_ct);
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+// runs the due tasks from the ctimer
+static void sched_run(void *ptr) {
+	sched_task_t *t, *next;
+	clock_time_t now = clock_time();
+
+	for (t = tasks; t != NULL; t = next) {
+		next = t->next;
+		if ((clock_time_t)(now - t->start) >= t->period) {
+			t->start += t->period;
+			/* more than one period late: no burst of runs to catch up */
+			if ((clock_time_t)(now - t->start) >= t->period) {
+				t->start = now;
+			}
+			t->fn();
+		}
+	}
+	sched_arm();
+}
+
+/*---------------------------------------------------------------------------*/
+void sched_add(sched_task_t *t, clock_time_t period, clock_time_t phase, void (*fn)(void)) {
+	sched_remove(t);
+	t->fn = fn;
+	t->period = period;
+	t->start = clock_time() + phase - period;
+	t->next = tasks;
+	tasks = t;
+	sched_arm();
+}
+
+/*---------------------------------------------------------------------------*/
+void sched_remove(sched_task_t *t) {
+	sched_task_t **p;
+
+	for (p = &tasks; *p != NULL; p = &(*p)->next) {
+		if (*p == t) {
+			*p = t->next;
+			break;
+		}
+	}
+	sched_arm();
+}
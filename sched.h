@@ -0,0 +1,35 @@
+/*
+|-------------------------------------------------------------------|
+| HCMC University of Technology                                     |
+| Telecommunications Departments                                    |
+| Wireless Embedded Firmware for Smart Lighting System (SLS)        |
+| Version: 2.0                                                      |
+| Author: sonvq@hcmut.edu.vn                                        |
+| Date: 01/2019                                                     |
+| HW support in ISM band: TelosB, CC2538, CC2530, CC1310, z1        |
+|-------------------------------------------------------------------|*/
+
+/* Periodic tasks on one timer.
+   A task runs every period, the first time phase after sched_add(). The timer is
+   set to the nearest deadline, so the CPU is not woken up while no task is due.
+   Periods stay below half the range of clock_time_t (255 s on sky/z1), phase <= period. */
+
+#ifndef SCHED_H_
+#define SCHED_H_
+
+#include "contiki.h"
+
+typedef struct sched_task {
+	struct sched_task	*next;
+	void				(*fn)(void);
+	clock_time_t		period;
+	clock_time_t		start;			/* next run at start + period */
+} sched_task_t;
+
+void	sched_init(void);
+/* tasks run in the context of the process that added the first one */
+void	sched_add(sched_task_t *t, clock_time_t period, clock_time_t phase, void (*fn)(void));
+/* a task may remove itself */
+void	sched_remove(sched_task_t *t);
+
+#endif /* SCHED_H_ */
@@ -12,6 +12,8 @@
 #ifndef SLS_H_
 #define SLS_H_
 
+#include <stddef.h>
+
 
 #define SLS_PAN_ID	 IEEE802154_CONF_PANID
 
@@ -19,19 +21,26 @@
 enum {
 	SLS_NORMAL_PORT			= 	3000,
 	SLS_EMERGENCY_PORT		= 	3001,
+	SLS_MULTICAST_PORT		= 	3002,
 };
 
+/* IPv6 group of all SLS nodes; scope 0xE, ROLL-TM forwards scopes above realm-local only */
+#define SLS_MCAST_GROUP(a)		uip_ip6addr(a, 0xFF1E, 0, 0, 0, 0, 0, 0x0089, 0xABCD)
+
 enum boolean {FALSE=0, TRUE=1};
 typedef enum boolean boolean;
 
 
-/* Set 1 to enable power trace: only for sky */
+/* Set 1 to enable power trace: only for sky (make WITH_COMPOWER=1) */
+#ifndef WITH_COMPOWER
 #define WITH_COMPOWER 		0
+#endif
 
 /*	ENCRYPTION_MODE
 	0: no encryption	
 	1: simple scrambling; 
-	2: Encryption AES-128  			*/
+	2: Encryption AES-128  	
+	3: AES-128 CCM: header in clear, rest encrypted in place, MIC in the last 4 bytes */
 #define ENCRYPTION_MODE		1
 
 #define PRINT_SENSOR		1
@@ -108,6 +117,9 @@ SLS_USING_HW = 4 : for compiling to Z1 used in Cooja simulation */
 #define CC2538DK_HAS_SHIELD
 #endif
 
+/* app-layer AES-CCM (ENCRYPTION_MODE 3) runs on the on-chip crypto engine */
+#define SLS_HW_CRYPTO			1
+
 
 #endif /* SLS_USING_CC2538DK */
 
@@ -137,7 +149,16 @@ SLS_USING_HW = 4 : for compiling to Z1 used in Cooja simulation */
 
 
 
+#ifndef SLS_HW_CRYPTO
+#define SLS_HW_CRYPTO			0
+#endif
+
+
+
 #define	SFD 			0x7F		/* Start of SLS frame Delimitter */
+#define	SFD_CCM 		0x7E		/* Start of a CCM protected frame (ENCRYPTION_MODE 3) */
+#define	SFD_COMPACT		0x7C		/* compact frame v1, CRC16 */
+#define	SFD_COMPACT_CCM	0x7D		/* compact frame v1, CCM protected (ENCRYPTION_MODE 3) */
 
 
 #define GW_ID_MASK		0x0000
@@ -156,6 +177,42 @@ SLS_USING_HW = 4 : for compiling to Z1 used in Cooja simulation */
 
 #define POLY 0x8408
 
+/* CRC16 lookup in util.c, ROM vs speed:
+   0 = nibble table (32 bytes), 1 = byte table (512 bytes), 2 = slicing-by-8 (4 KB) */
+#ifndef CRC16_TABLE
+#if defined(SLS_GATEWAY_SIDE)
+#define CRC16_TABLE		2
+#elif defined(SLS_USING_SKY)
+#define CRC16_TABLE		0
+#else
+#define CRC16_TABLE		1
+#endif
+#endif
+
+/* ENCRYPTION_MODE 3: MIC of RFC 3610 CCM (M = 4). A fixed frame carries it in its last
+   CCM_MIC_LEN bytes, the CRC field and the arg bytes before it, so it holds CCM_DATA_LEN
+   arg bytes; a compact frame appends it to its arg */
+#define CCM_MIC_LEN		4
+#define CCM_DATA_LEN	(MAX_CMD_DATA_LEN + sizeof(uint16_t) - CCM_MIC_LEN)
+/* longest frame on air: a compact CCM frame with MAX_CMD_DATA_LEN arg bytes */
+#define MAX_FRAME_LEN	(sizeof(struct cmd_struct_t) - sizeof(uint16_t) + CCM_MIC_LEN)
+
+/* direction byte of the CCM nonce: a reply and the request it answers carry the same seq */
+#define CCM_DIR_DOWNLINK	0x00		/* gateway -> node */
+#define CCM_DIR_UPLINK		0x01		/* node -> gateway */
+#define CCM_DIR_COMPACT		0x02		/* or-ed in for compact frames, so both formats never share a nonce */
+
+/* rest of the CCM nonce, so that a key shared by nodes and kept across sessions never
+   sees the same nonce twice (the seqs restart at each CMD_RF_AUTHENTICATE):
+   node: last CCM_NODE_LEN bytes of the link-layer address of the node, the gateway
+   takes them from the IID of its IPv6 address;
+   salt: challenge code of the last CMD_RF_AUTHENTICATE, then the salt the node returns
+   in arg[20..21] of its reply, both big endian.
+   Group msgs (SLS_MULTICAST_PORT) use an all-zero session: the gateway changes the
+   group key before its group seq wraps. */
+#define CCM_NODE_LEN		4
+#define CCM_SALT_LEN		4
+
 static uint8_t iv[16]  = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, \
                            0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f };
 
@@ -164,12 +221,16 @@ enum {		// msg type
 	MSG_TYPE_REP			= 0x02,
 	MSG_TYPE_HELLO			= 0x03,
 	MSG_TYPE_ASYNC			= 0x04,
+	MSG_TYPE_ASYNC_ACK		= 0x05,		/* gateway -> node on SLS_EMERGENCY_PORT, seq of the ASYNC msg */
+	MSG_TYPE_BUNDLE			= 0x06,		/* REQ with a TLV list of commands in arg, see BUNDLE_ITEM_HDR_LEN */
 };
 
 enum {	// msg type
 	ASYNC_MSG_JOINED		= 0x01,
 	ASYNC_MSG_LED_DRIVER	= 0x02,
 	ASYNC_MSG_SENT			= 0x03,
+	ASYNC_MSG_SENSOR_AGG	= 0x04,		/* sensor readings of one window, see SENSOR_AGG_HDR_LEN */
+	ASYNC_MSG_SENSOR_DELTA	= 0x05,		/* the same, as changes to an acked report, see SENSOR_DELTA_HDR_LEN */
 };
 
 enum {	//command id
@@ -209,6 +270,9 @@ enum {	//command id
 
 	CMD_GW_RELOAD_FW		= 0xE3,
 	CMD_RF_AUTHENTICATE		= 0xE2,
+	CMD_SET_GROUP_KEY		= 0xE1,		/* arg[0..15]: key of the SLS_MCAST_GROUP frames; only encrypted with the app key */
+	CMD_SET_GROUP			= 0xE0,		/* arg[0..1]: group mask of the node */
+	CMD_GW_GROUP_CMD		= 0xDF,		/* group msg: arg[0..1] group mask, arg[2] cmd, its args after */
 
 
 	/* for LED-driver */
@@ -260,6 +324,8 @@ enum {
 	ERR_RF_LOST_POWER		= 0x07,
 	ERR_GW_LOST_POWER		= 0x08,
 	ERR_CMD_CRC_ERROR		= 0x09,
+	ERR_BUNDLE_OVERFLOW		= 0x0A,		/* the result of a bundle item did not fit in the reply */
+	ERR_BUNDLE_FORMAT		= 0x0B,		/* a bundle item runs past the end of arg */
 };
 
 enum {	//state machine
@@ -268,6 +334,72 @@ enum {	//state machine
 	STATE_EMERGENCY			= 0x02,
 };
 
+/*---------------------------------------------------------------------------*/
+//	anti-replay window of the REQ seq: top is the newest seq accepted, bit i of
+//	map is set when seq top-i was accepted; older seqs and repeats are refused
+#ifndef SEQ_WINDOW_SIZE
+#define SEQ_WINDOW_SIZE		32		/* 32 or 64 */
+#endif
+
+#if (SEQ_WINDOW_SIZE == 64)
+typedef uint64_t	seq_map_t;
+#elif (SEQ_WINDOW_SIZE == 32)
+typedef uint32_t	seq_map_t;
+#else
+#error "SEQ_WINDOW_SIZE must be 32 or 64"
+#endif
+
+struct seq_window_struct_t {
+	uint16_t	top;
+	seq_map_t	map;		/* 0: empty, the next seq is accepted */
+};
+
+/*---------------------------------------------------------------------------*/
+//	ASYNC_MSG_SENSOR_AGG: min/max/mean/last of the readings since the last report,
+//	packed by sensor_agg_pack(), unpacked by the gateway with sensor_agg_unpack():
+//	n[1]			readings in the window
+//	shift[2]		4 bits per field, field 0 in the high nibble of the first byte
+//	per field[5]	mean[2] big-endian, in the unit of env_struct_t;
+//					min, max, last: int8, (value - mean) >> shift
+//	fields: temp (signed), light, pressure, humidity
+#define SENSOR_FIELDS		4
+#define SENSOR_SIGNED		0x01		/* fields holding an int16_t */
+#define SENSOR_AGG_HDR_LEN	3
+#define SENSOR_AGG_LEN		(SENSOR_AGG_HDR_LEN + 5*SENSOR_FIELDS)
+
+//	ASYNC_MSG_SENSOR_DELTA: the same report as the changes to the last one the gateway acked,
+//	packed by sensor_delta_pack(), unpacked with sensor_delta_unpack():
+//	n[1]			readings in the window
+//	base[1]			low byte of the seq of the acked report the changes apply to
+//	present[2]		big-endian, bit i: value i changed; values are the min of each field,
+//					then max, mean, last (bit 0: min of temp, bit 4: max of temp...)
+//	varint[]		per changed value, the difference, zig-zag coded, 7 bits per byte,
+//					least significant first, bit 7 set on all but the last byte
+//	The gateway keeps the last reports of a node by seq. The node sends a SENSOR_AGG
+//	report when it has no acked report yet or the changes do not fit.
+#define SENSOR_VALUES		(4*SENSOR_FIELDS)
+#define SENSOR_DELTA_HDR_LEN	4
+
+struct sensor_agg_t {
+	uint8_t		n;
+	int32_t		min[SENSOR_FIELDS];
+	int32_t		max[SENSOR_FIELDS];
+	int32_t		mean[SENSOR_FIELDS];
+	int32_t		last[SENSOR_FIELDS];
+};
+
+/*---------------------------------------------------------------------------*/
+//	used by gateway: ASYNC msgs already received from a node, a retransmission
+//	whose ACK was lost is acked again but not delivered twice
+#define ASYNC_DEDUP_DEPTH	8		/* >= in-flight window of the node */
+
+struct async_rx_struct_t {
+	uint8_t		node[8];			/* interface id of the node address */
+	uint16_t	seq[ASYNC_DEDUP_DEPTH];
+	uint8_t		next;
+	uint8_t		used;
+};
+
 /*---------------------------------------------------------------------------*/
 //	used by gateway
 struct gw_struct_t {
@@ -325,6 +457,12 @@ struct env_struct_t {
 	
 } __attribute__((packed));
 
+/* group membership of a node, bit n: member of group n. GROUP_ODD/GROUP_EVEN follow the
+   parity of the node address at boot and are what the _ODD/_EVEN commands address;
+   CMD_SET_GROUP replaces the whole mask */
+#define GROUP_ODD			0x0001
+#define GROUP_EVEN			0x0002
+
 /* This data structure is used to store the packet content (payload) */
 struct net_struct_t {
 	uint8_t			channel;	
@@ -333,6 +471,7 @@ struct net_struct_t {
 	int8_t			tx_power;
 	uint16_t		panid;
 	uint16_t		node_addr;
+	uint16_t		groups;
 	uint8_t			connected;
 	uint8_t			lost_connection_cnt;
 	unsigned char	app_code[16];
@@ -346,7 +485,7 @@ struct net_struct_t {
 //	sfd[1] 			= 0x7F (Start of Frame Delimitter)
 //	len[1]: 		used for App node_id
 //	seq[2]: 		transaction id;
-//	type[1]: 		REQUEST/REPLY/HELLO/ASYNC
+//	type[1]: 		REQUEST/REPLY/HELLO/ASYNC/ASYNC_ACK
 //	cmd[1]:			command id: which command excecuted at node
 //	err_code[1]: 	code returned in REPLY, sender check this field to know the REQ status
 //	arg[n]: 		data payload
@@ -363,6 +502,70 @@ struct cmd_struct_t {
 	uint16_t	crc;
 };
 
+/*---------------------------------------------------------------------------*/
+//	replies already sent, as they went on air (encrypted): a request repeated
+//	because its reply was lost gets the same frame again, without executing it twice.
+//	The key is seq, type, cmd and the CRC/MIC field of the request.
+#ifndef REPLY_CACHE_LEN
+#define REPLY_CACHE_LEN		4
+#endif
+
+struct reply_cache_entry_t {
+	uint16_t		seq;
+	uint16_t		req_crc;
+	uint8_t			type;
+	uint8_t			cmd;
+	uint8_t			valid;		/* frame holds the reply */
+	uint8_t			frame_len;	/* MAX_CMD_LEN, or the length of a compact frame */
+	uint8_t			frame[MAX_FRAME_LEN];
+};
+
+struct reply_cache_struct_t {
+	struct reply_cache_entry_t	entry[REPLY_CACHE_LEN];
+	uint8_t			next;
+};
+
+struct ccm_session_t {
+	uint8_t		node[CCM_NODE_LEN];
+	uint8_t		salt[CCM_SALT_LEN];
+};
+
+/*---------------------------------------------------------------------------*/
+//	Compact frame v1: the fields of cmd_struct_t without the unused arg bytes,
+//	packed, little-endian, built and parsed by make_compact_frame()/parse_compact_frame():
+//	sfd[1] 			= SFD_COMPACT, or SFD_COMPACT_CCM when encrypted
+//	len[1]: 		number of arg bytes, 0..MAX_CMD_DATA_LEN
+//	seq[2], type[1], cmd[1], err_code[1]
+//	arg[len]
+//	crc[2]			CRC16, or mic[CCM_MIC_LEN] of a SFD_COMPACT_CCM frame
+//	The fixed 32-byte format stays accepted; a reply uses the format of its request.
+#define COMPACT_HDR_LEN		7
+#define COMPACT_FRAME_LEN(n)	(COMPACT_HDR_LEN + (n) + sizeof(uint16_t))
+#define COMPACT_CCM_FRAME_LEN(n)	(COMPACT_HDR_LEN + (n) + CCM_MIC_LEN)
+
+/* both formats share the layout of the header, the fixed one must be the same on every target */
+#define SLS_CT_ASSERT(name, cond)	typedef char sls_ct_assert_##name[(cond) ? 1 : -1]
+SLS_CT_ASSERT(cmd_size, sizeof(struct cmd_struct_t) == 32);
+SLS_CT_ASSERT(cmd_seq, offsetof(struct cmd_struct_t, seq) == 2);
+SLS_CT_ASSERT(cmd_arg, offsetof(struct cmd_struct_t, arg) == COMPACT_HDR_LEN);
+SLS_CT_ASSERT(cmd_crc, offsetof(struct cmd_struct_t, crc) == COMPACT_HDR_LEN + MAX_CMD_DATA_LEN);
+SLS_CT_ASSERT(sensor_agg, SENSOR_AGG_LEN <= MAX_CMD_DATA_LEN);
+/* 13-byte nonce of CCM with a 2-byte length field: dir, len, seq, type, node, salt */
+SLS_CT_ASSERT(ccm_nonce, 1 + 4 + CCM_NODE_LEN + CCM_SALT_LEN == 13);
+/* M of RFC 3610: 4, 6, .. 16 */
+SLS_CT_ASSERT(ccm_mic, (CCM_MIC_LEN >= 4) && (CCM_MIC_LEN <= 16) && ((CCM_MIC_LEN & 1) == 0));
+SLS_CT_ASSERT(max_frame, MAX_FRAME_LEN == COMPACT_CCM_FRAME_LEN(MAX_CMD_DATA_LEN));
+
+/*---------------------------------------------------------------------------*/
+//	Bundle: MSG_TYPE_BUNDLE carries several network commands in the arg of one frame,
+//	executed in order under the seq of the frame (cmd of the frame is not used):
+//	request item	cmd[1] len[1] value[len]		a cmd 0x00 or the end of arg ends the list
+//	reply item		cmd[1] err_code[1] len[1] data[len]
+//	The reply is a MSG_TYPE_REP with one item per executed command. err_code of the reply is
+//	ERR_BUNDLE_OVERFLOW when items were left out for lack of room, ERR_BUNDLE_FORMAT on a bad list.
+#define BUNDLE_ITEM_HDR_LEN		2
+#define BUNDLE_RES_HDR_LEN		3
+
 union float_byte_convert {
     float f;
     uint8_t bytes[4];
@@ -373,5 +576,11 @@ typedef struct net_struct_t		net_struct_t;
 typedef struct gw_struct_t		gw_struct_t;
 typedef struct led_struct_t		led_struct_t;
 typedef struct env_struct_t		env_struct_t;
+typedef struct async_rx_struct_t	async_rx_struct_t;
+typedef struct sensor_agg_t			sensor_agg_t;
+typedef struct seq_window_struct_t	seq_window_struct_t;
+typedef struct reply_cache_entry_t	reply_cache_entry_t;
+typedef struct reply_cache_struct_t	reply_cache_struct_t;
+typedef struct ccm_session_t		ccm_session_t;
 	
 #endif /* SLS_H_ */
@@ -0,0 +1,228 @@
+/*
+|-------------------------------------------------------------------|
+| HCMC University of Technology                                     |
+| Telecommunications Departments                                    |
+| Wireless Embedded Firmware for Smart Lighting System (SLS)        |
+| Version: 2.0                                                      |
+| Author: sonvq@hcmut.edu.vn                                        |
+| Date: 01/2019                                                     |
+| HW support in ISM band: TelosB, CC2538, CC2530, CC1310, z1        |
+|-------------------------------------------------------------------|*/
+
+/* Host test of ENCRYPTION_MODE 3: the CC2538 path of util.c (hw_ccm_crypt) runs on a
+   software stand-in of the crypto engine and must give the same bytes as ccm_crypt(),
+   both ways, for fixed and compact frames. The stand-in is a plain RFC 3610 CCM over
+   its own key store, which is lost by crypto_disable() like the real one.
+   make ccm-test */
+
+#include <stdlib.h>
+
+#define SLS_HW_CRYPTO	1
+#include "util.c"
+
+/*---------------------------------------------------------------------------*/
+/* stand-in of the engine */
+#define KEY_AREAS		8
+
+static uint8_t	engine_on;
+static uint8_t	key_store[KEY_AREAS][16];
+static uint8_t	key_valid[KEY_AREAS];
+static uint8_t	tag[16];
+static uint16_t	engine_runs, key_loads;
+
+void crypto_enable(void) {
+	engine_on = 1;
+}
+
+void crypto_disable(void) {
+	engine_on = 0;
+	memset(key_valid, 0, sizeof(key_valid));
+}
+
+uint8_t crypto_is_enabled(void) {
+	return engine_on;
+}
+
+uint8_t aes_load_keys(const void *keys, uint8_t key_size, uint8_t count, uint8_t start_area) {
+	uint8_t i;
+
+	if (!engine_on || (key_size != AES_KEY_STORE_SIZE_KEY_SIZE_128) || (start_area + count > KEY_AREAS))
+		return AES_KEYSTORE_READ_ERROR;
+	for (i=0; i<count; i++) {
+		memcpy(key_store[start_area+i], (const uint8_t *)keys + 16*i, 16);
+		key_valid[start_area+i] = 1;
+	}
+	key_loads++;
+	return CRYPTO_SUCCESS;
+}
+
+/*---------------------------------------------------------------------------*/
+// RFC 3610 without associated data: CBC-MAC over the plaintext, then CTR
+static uint8_t engine_ccm(uint8_t len_len, uint8_t key_area, const uint8_t *nonce, uint16_t adata_len,
+						  uint8_t *data, uint16_t len, uint8_t mic_len, uint8_t encrypt) {
+	aes128_ctx k;
+	uint8_t x[16], a[16], s[16];
+	uint16_t i, j, n;
+
+	if (!engine_on || (key_area >= KEY_AREAS) || !key_valid[key_area])
+		return AES_KEYSTORE_READ_ERROR;
+	if ((adata_len != 0) || (len_len != 2))
+		return AES_KEYSTORE_READ_ERROR;
+	AES128_init_ctx(&k, key_store[key_area]);
+
+	// A_i = (L-1) | nonce | i
+	a[0] = len_len - 1;
+	memcpy(&a[1], nonce, 15 - len_len);
+	if (!encrypt) {
+		for (i=0; i<len; i+=16) {
+			a[14] = (i/16 + 1) >> 8;
+			a[15] = (i/16 + 1) & 0xFF;
+			memcpy(s, a, 16);
+			AES128_ECB_encrypt_ctx(&k, s);
+			n = (len - i < 16) ? len - i : 16;
+			for (j=0; j<n; j++)
+				data[i+j] ^= s[j];
+		}
+	}
+
+	// B_0 = flags | nonce | len, then the CBC-MAC of the zero-padded plaintext
+	x[0] = (((mic_len - 2)/2) << 3) | (len_len - 1);
+	memcpy(&x[1], nonce, 15 - len_len);
+	x[14] = len >> 8;
+	x[15] = len & 0xFF;
+	AES128_ECB_encrypt_ctx(&k, x);
+	for (i=0; i<len; i+=16) {
+		n = (len - i < 16) ? len - i : 16;
+		for (j=0; j<n; j++)
+			x[j] ^= data[i+j];
+		AES128_ECB_encrypt_ctx(&k, x);
+	}
+
+	if (encrypt) {
+		for (i=0; i<len; i+=16) {
+			a[14] = (i/16 + 1) >> 8;
+			a[15] = (i/16 + 1) & 0xFF;
+			memcpy(s, a, 16);
+			AES128_ECB_encrypt_ctx(&k, s);
+			n = (len - i < 16) ? len - i : 16;
+			for (j=0; j<n; j++)
+				data[i+j] ^= s[j];
+		}
+	}
+
+	a[14] = a[15] = 0;
+	memcpy(s, a, 16);
+	AES128_ECB_encrypt_ctx(&k, s);
+	for (j=0; j<mic_len; j++)
+		tag[j] = x[j] ^ s[j];
+	engine_runs++;
+	return CRYPTO_SUCCESS;
+}
+
+uint8_t ccm_auth_encrypt_start(uint8_t len_len, uint8_t key_area, const void *nonce,
+							   const void *adata, uint16_t adata_len, void *pdata,
+							   uint16_t pdata_len, uint8_t mic_len, struct process *process) {
+	return engine_ccm(len_len, key_area, nonce, adata_len, pdata, pdata_len, mic_len, 1);
+}
+
+uint8_t ccm_auth_encrypt_check_status(void) {
+	return 1;
+}
+
+uint8_t ccm_auth_encrypt_get_result(void *mic, uint8_t mic_len) {
+	memcpy(mic, tag, mic_len);
+	return CRYPTO_SUCCESS;
+}
+
+uint8_t ccm_auth_decrypt_start(uint8_t len_len, uint8_t key_area, const void *nonce,
+							   const void *adata, uint16_t adata_len, void *cdata,
+							   uint16_t cdata_len, uint8_t mic_len, struct process *process) {
+	return engine_ccm(len_len, key_area, nonce, adata_len, cdata, cdata_len - mic_len, mic_len, 0);
+}
+
+uint8_t ccm_auth_decrypt_check_status(void) {
+	return 1;
+}
+
+uint8_t ccm_auth_decrypt_get_result(const void *cdata, uint16_t cdata_len, void *mic, uint8_t mic_len) {
+	memcpy(mic, tag, mic_len);
+	if (memcmp((const uint8_t *)cdata + cdata_len - mic_len, tag, mic_len) != 0)
+		return CCM_AUTHENTICATION_FAILED;
+	return CRYPTO_SUCCESS;
+}
+
+/*---------------------------------------------------------------------------*/
+void log_put(uint8_t ev, const uint16_t *args, uint8_t n) {
+}
+
+void log_put_hex(uint8_t ev, const void *data, uint8_t len) {
+}
+
+/*---------------------------------------------------------------------------*/
+static int fails;
+
+static void check(int ok, const char *what, int i) {
+	if (!ok) {
+		printf("FAIL %s, frame %d\n", what, i);
+		fails++;
+	}
+}
+
+static void fill(uint8_t *p, uint16_t n) {
+	while (n--)
+		*p++ = rand() & 0xFF;
+}
+
+/*---------------------------------------------------------------------------*/
+int main(void) {
+	uint8_t key[16], plain[MAX_FRAME_LEN], sw[MAX_FRAME_LEN], hw[MAX_FRAME_LEN];
+	ccm_session_t ses;
+	aes128_ctx *ctx;
+	uint8_t body_len, dir;
+	uint16_t runs;
+	int i;
+
+	srand(2538);
+	for (i=0; i<2000; i++) {
+		if ((i % 50) == 0)
+			fill(key, 16);
+		if ((i % 200) == 100)
+			crypto_disable();			/* the key store is lost, hw_load_key() must load it again */
+		ctx = get_app_ctx(key);
+		fill((uint8_t *)&ses, sizeof(ses));
+		fill(plain, MAX_FRAME_LEN);
+		dir = rand() & CCM_DIR_UPLINK;
+		if (rand() & 1) {
+			body_len = CCM_BODY_LEN;	/* fixed frame, MIC in its last bytes */
+		} else {
+			body_len = rand() % (MAX_CMD_DATA_LEN + 1) + COMPACT_HDR_LEN - CCM_HDR_LEN;
+			dir |= CCM_DIR_COMPACT;
+		}
+
+		// encrypt: same ciphertext and MIC from both backends
+		memcpy(sw, plain, MAX_FRAME_LEN);
+		memcpy(hw, plain, MAX_FRAME_LEN);
+		ccm_crypt(sw, body_len, sw + CCM_HDR_LEN + body_len, ctx, &ses, dir, TRUE);
+		runs = engine_runs;
+		check(hw_ccm_crypt(hw, body_len, hw + CCM_HDR_LEN + body_len, ctx, &ses, dir, TRUE) == TRUE, "hw encrypt", i);
+		check(engine_runs == runs + 1, "hw encrypt did not run on the engine", i);
+		check(memcmp(sw, hw, CCM_HDR_LEN + body_len + CCM_MIC_LEN) == 0, "encrypt differs", i);
+
+		// decrypt: each backend opens the frame of the other
+		check(hw_ccm_crypt(sw, body_len, sw + CCM_HDR_LEN + body_len, ctx, &ses, dir, FALSE) == TRUE, "hw decrypt", i);
+		check(ccm_crypt(hw, body_len, hw + CCM_HDR_LEN + body_len, ctx, &ses, dir, FALSE) == TRUE, "sw decrypt", i);
+		check(memcmp(sw, plain, CCM_HDR_LEN + body_len) == 0, "hw plaintext", i);
+		check(memcmp(hw, plain, CCM_HDR_LEN + body_len) == 0, "sw plaintext", i);
+
+		// a changed byte (the sfd only selects the format) or another session: both reject the frame
+		ccm_crypt(sw, body_len, sw + CCM_HDR_LEN + body_len, ctx, &ses, dir, TRUE);
+		memcpy(hw, sw, MAX_FRAME_LEN);
+		sw[1 + rand() % (CCM_HDR_LEN - 1 + body_len)] ^= 1 << (rand() % 8);
+		check(hw_ccm_crypt(sw, body_len, sw + CCM_HDR_LEN + body_len, ctx, &ses, dir, FALSE) == FALSE, "hw accepts a changed frame", i);
+		ses.salt[rand() % CCM_SALT_LEN] ^= 0x80;
+		check(ccm_crypt(hw, body_len, hw + CCM_HDR_LEN + body_len, ctx, &ses, dir, FALSE) == FALSE, "sw accepts another session", i);
+	}
+
+	printf("ccm-test: %d frames, %u key loads, %s\n", i, key_loads, fails ? "FAILED" : "hw == sw");
+	return fails ? 1 : 0;
+}
@@ -0,0 +1,126 @@
+/*
+|-------------------------------------------------------------------|
+| HCMC University of Technology                                     |
+| Telecommunications Departments                                    |
+| Wireless Embedded Firmware for Smart Lighting System (SLS)        |
+| Version: 2.0                                                      |
+| Author: sonvq@hcmut.edu.vn                                        |
+| Date: 01/2019                                                     |
+| HW support in ISM band: TelosB, CC2538, CC2530, CC1310, z1        |
+|-------------------------------------------------------------------|*/
+
+/* Host benchmark of gen_crc16() in util.c against the bit-wise loop it replaced.
+   Build once per table size with -DCRC16_TABLE=0/1/2; each run first checks that the
+   table gives the same CRC as the bit-wise loop, whole and split at random points,
+   then prints the best time per frame (MAX_CMD_LEN-2 bytes, as gen_crc_for_cmd()).
+   make crc16-bench */
+
+#include <stdlib.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "util.c"
+
+#define FRAMES		2000
+#define ROUNDS		64
+
+/*---------------------------------------------------------------------------*/
+// gen_crc16() before the tables, kept as the reference
+static uint16_t crc16_bitwise(uint8_t *data_p, unsigned short  length) {
+    unsigned char i;
+    unsigned int data;
+    unsigned int crc = 0xffff;
+    uint8_t len;
+    len = length;
+
+    if (len== 0)
+        return (~crc);
+    do    {
+        for (i=0, data=(unsigned int)0xff & *data_p++; i < 8; i++, data >>= 1) {
+            if ((crc & 0x0001) ^ (data & 0x0001))
+                crc = (crc >> 1) ^ POLY;
+            else  crc >>= 1;
+        }
+    } while (--len);
+
+    crc = ~crc;
+    data = crc;
+    crc = (crc << 8) | (data >> 8 & 0xff);
+    return (crc);
+}
+
+/*---------------------------------------------------------------------------*/
+void log_put(uint8_t ev, const uint16_t *args, uint8_t n) {
+}
+
+void log_put_hex(uint8_t ev, const void *data, uint8_t len) {
+}
+
+/*---------------------------------------------------------------------------*/
+// cycles on x86, nanoseconds elsewhere
+static uint64_t now(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+#endif
+}
+
+static volatile uint16_t sink;
+
+static uint64_t best_of(uint16_t (*crc)(uint8_t *, unsigned short), uint8_t frames[][MAX_CMD_LEN]) {
+    uint64_t t, best = (uint64_t)-1;
+    int i, r;
+
+    for (i=0; i<FRAMES; i++) {
+        t = now();
+        for (r=0; r<ROUNDS; r++)
+            sink = crc(frames[i], MAX_CMD_LEN-2);
+        t = now() - t;
+        if (t < best)
+            best = t;
+    }
+    return best / ROUNDS;
+}
+
+/*---------------------------------------------------------------------------*/
+int main(void) {
+    static uint8_t frames[FRAMES][MAX_CMD_LEN];
+    uint8_t buf[255];
+    uint16_t len, cut, crc;
+    int i, fails = 0;
+
+    // same CRC as the bit-wise loop, for any length up to 255 and any split
+    srand(8408);
+    for (i=0; i<20000; i++) {
+        len = rand() % (sizeof(buf) + 1);
+        cut = (len == 0) ? 0 : rand() % (len + 1);
+        for (crc=0; crc<len; crc++)
+            buf[crc] = rand() & 0xFF;
+        crc = gen_crc16_update(gen_crc16_init(), buf, cut);
+        crc = gen_crc16_final(gen_crc16_update(crc, buf + cut, len - cut));
+        if ((crc != crc16_bitwise(buf, len)) || (gen_crc16(buf, len) != crc)) {
+            printf("FAIL crc of %u bytes split at %u\n", len, cut);
+            fails++;
+        }
+    }
+
+    for (i=0; i<FRAMES; i++)
+        for (len=0; len<MAX_CMD_LEN; len++)
+            frames[i][len] = rand() & 0xFF;
+
+    printf("crc16-bench: CRC16_TABLE %d, %u-byte frame, %s per frame (best of %d):"
+           " bit-wise %lu, table %lu%s\n", CRC16_TABLE, (unsigned)(MAX_CMD_LEN-2),
+#if defined(__x86_64__) || defined(__i386__)
+           "cycles",
+#else
+           "ns",
+#endif
+           FRAMES, (unsigned long)best_of(crc16_bitwise, frames), (unsigned long)best_of(gen_crc16, frames),
+           fails ? ", FAILED" : "");
+    return fails ? 1 : 0;
+}
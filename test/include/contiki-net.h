@@ -0,0 +1,2 @@
+/* Host stand-in, see contiki.h */
+#include "contiki.h"
@@ -0,0 +1,11 @@
+/* Host stand-in for Contiki, just what util.c needs to build in the host tests under test/ */
+#ifndef CONTIKI_H_
+#define CONTIKI_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+struct process;
+
+#endif /* CONTIKI_H_ */
@@ -0,0 +1,12 @@
+/* Host stand-in of the CC2538 AES driver, implemented in test/ccm-test.c */
+#ifndef AES_H_
+#define AES_H_
+
+#include "contiki.h"
+
+#define AES_KEY_STORE_SIZE_KEY_SIZE_128		0x00000001
+#define AES_KEYSTORE_READ_ERROR				5
+
+uint8_t	aes_load_keys(const void *keys, uint8_t key_size, uint8_t count, uint8_t start_area);
+
+#endif /* AES_H_ */
@@ -0,0 +1,20 @@
+/* Host stand-in of the CC2538 CCM driver, implemented in test/ccm-test.c */
+#ifndef CCM_H_
+#define CCM_H_
+
+#include "contiki.h"
+
+#define CCM_AUTHENTICATION_FAILED	7
+
+uint8_t	ccm_auth_encrypt_start(uint8_t len_len, uint8_t key_area, const void *nonce,
+							   const void *adata, uint16_t adata_len, void *pdata,
+							   uint16_t pdata_len, uint8_t mic_len, struct process *process);
+uint8_t	ccm_auth_encrypt_check_status(void);
+uint8_t	ccm_auth_encrypt_get_result(void *mic, uint8_t mic_len);
+uint8_t	ccm_auth_decrypt_start(uint8_t len_len, uint8_t key_area, const void *nonce,
+							   const void *adata, uint16_t adata_len, void *cdata,
+							   uint16_t cdata_len, uint8_t mic_len, struct process *process);
+uint8_t	ccm_auth_decrypt_check_status(void);
+uint8_t	ccm_auth_decrypt_get_result(const void *cdata, uint16_t cdata_len, void *mic, uint8_t mic_len);
+
+#endif /* CCM_H_ */
@@ -0,0 +1,13 @@
+/* Host stand-in of the CC2538 crypto driver, implemented in test/ccm-test.c */
+#ifndef CRYPTO_H_
+#define CRYPTO_H_
+
+#include "contiki.h"
+
+#define CRYPTO_SUCCESS		0
+
+void	crypto_enable(void);
+void	crypto_disable(void);
+uint8_t	crypto_is_enabled(void);
+
+#endif /* CRYPTO_H_ */
@@ -0,0 +1,7 @@
+/* Host stand-in, see contiki.h */
+#ifndef UIP_DEBUG_H
+#define UIP_DEBUG_H
+
+#define PRINTF(...)
+
+#endif /* UIP_DEBUG_H */
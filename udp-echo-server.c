@@ -39,7 +39,6 @@ Topology description:
 
 #include "random.h"
 
-#include "sys/etimer.h"
 #include "sys/ctimer.h"
 
 
@@ -49,6 +48,9 @@ Topology description:
 
 #include "sls.h"	
 #include "util.h"	
+#include "log_buf.h"
+#include "led_anim.h"
+#include "sched.h"
 
 
 #ifdef SLS_USING_SKY
@@ -79,9 +81,37 @@ Topology description:
 
 #define MAX_PAYLOAD_LEN 			120
 #define SEND_ASYNC_MSG_CONTINUOUS	TRUE 		// set FALSE to send once
-#define SEND_ASYN_MSG_PERIOD		60			// seconds
 #define READ_SENSOR_PERIOD			30			// seconds
-#define NUM_ASYNC_MSG_RETRANS   	2           // for async msg
+#define JOIN_CHECK_PERIOD			50			// seconds: RPL parent checked, JOINED msg sent until authenticated
+#ifndef LED_HEARTBEAT_PERIOD
+#define LED_HEARTBEAT_PERIOD		CLOCK_SECOND	// RED toggled while connected; 0: no heartbeat, no wake-up for it
+#endif
+#define SENSOR_RING_LEN				16			// readings kept for the next report, power of 2
+#define TELEMETRY_HEARTBEAT			(SENSOR_RING_LEN*READ_SENSOR_PERIOD)	// seconds: a report at least this often, before readings are overwritten
+#define DEADBAND_TEMP				5			// 0.5 ºC: env_db is sent when a value moves this far
+#define DEADBAND_LIGHT				20			// lux
+#define DEADBAND_PRESSURE			10			// 1 hPa
+#define DEADBAND_HUMIDITY			1049		// 2 %RH, Si7021 raw code
+#define NUM_ASYNC_MSG_RETRANS   	4           // for async msg: retransmissions until the ACK
+#define ASYNC_QUEUE_LEN				4			// async msgs waiting to be sent or acked
+#define ASYNC_WINDOW				2			// async msgs sent and not acked yet
+#define ASYNC_RTO_INIT				(CLOCK_SECOND*4)	// ACK timeout, doubled at each retransmission
+#define ASYNC_RTO_MAX				(CLOCK_SECOND*32)
+#define ASYNC_JITTER_MAX			(CLOCK_SECOND/4)	// random delay added before each async transmission
+#define ASYNC_COMPACT				TRUE		// async msgs as compact frames when the encryption allows it
+
+/* compact async msgs only in ENCRYPTION_MODE 0, or CCM-encrypted in mode 3; the clear msgs of
+   modes 1..3 (JOINED, before the app key) keep the 32-byte frame a stock gateway expects */
+#define ASYNC_COMPACT_OK(enc)		((ASYNC_COMPACT == TRUE) && \
+									 ((ENCRYPTION_MODE == 0) || ((ENCRYPTION_MODE == 3) && ((enc) == TRUE))))
+/* a fixed CCM frame holds CCM_DATA_LEN arg bytes only, too few for a SENSOR_AGG report */
+SLS_CT_ASSERT(async_ccm, (ENCRYPTION_MODE != 3) || (ASYNC_COMPACT == TRUE));
+
+#if defined(SLS_USING_SKY) || defined(SLS_USING_Z1)
+#define PEER_TABLE_LEN				2			// controllers served at the same time
+#else
+#define PEER_TABLE_LEN				4
+#endif
 
 
 // CC2538DK has shield with sensors
@@ -102,8 +132,35 @@ static 	int cmd_cnt;
 
 /*---------------------------------------------------------------------------*/
 static struct uip_udp_conn *server_conn;
-static char buf[MAX_PAYLOAD_LEN];
-static uint16_t len, curr_seq, new_seq, async_seq;
+static uint16_t len, new_seq, async_seq;
+
+/* one session per requester (gateway, operator tool), keyed by its address */
+typedef struct {
+	uip_ipaddr_t			addr;
+	uint16_t				port;			/* source port of its last request, network order */
+	uint16_t				last_used;
+	uint8_t					used;
+	uint8_t					authenticated;	/* got its APP_KEY: its frames are encrypted */
+	unsigned char			app_code[16];
+	seq_window_struct_t		window;			/* REQ seqs already executed */
+	reply_cache_struct_t	cache;
+	ccm_session_t			ccm;			/* CCM nonce of the session, set by CMD_RF_AUTHENTICATE */
+} peer_t;
+
+static peer_t	peers[PEER_TABLE_LEN];
+static peer_t	*cur_peer;					/* sender of the request being processed */
+static uint16_t	peer_clock;
+static reply_cache_entry_t *reply_slot;		/* send_reply() keeps the reply of the current request here */
+static uint8_t	reply_compact;				/* the current request came as a compact frame, so does its reply */
+static uint8_t	rx_secured;					/* the last checked frame was decrypted and verified with its key */
+
+/* commands to the group of all nodes (SLS_MULTICAST_PORT): encrypted with the
+   group key, executed without a reply */
+static struct uip_udp_conn *mcast_conn;
+static unsigned char		group_key[16];
+static uint8_t				group_key_valid;
+static seq_window_struct_t	group_window;		/* group seqs already executed */
+static const ccm_session_t	group_ccm;			/* all zero, see ccm_session_t */
 
 
 /* SLS define */
@@ -111,7 +168,9 @@ static 	led_struct_t led_db;
 static 	gw_struct_t gw_db;
 static 	net_struct_t net_db;
 static 	env_struct_t env_db;
-static 	cmd_struct_t cmd, reply, emer_reply;
+static 	cmd_struct_t reply, emer_reply;		/* reply: the TX buffer, replies and async msgs are built and encrypted here */
+static 	cmd_struct_t cmd_scratch;			/* the results of a bundle, or the command of a group msg */
+static 	uint8_t tx_frame[MAX_FRAME_LEN];	/* compact frames of reply, a CCM one may be longer than reply */
 static 	radio_value_t aux;
 static	int	state;
 
@@ -120,17 +179,45 @@ static	int	state;
 /*define timers */
 static struct uip_udp_conn *client_conn;
 static uip_ipaddr_t server_ipaddr;
-static	struct	etimer	et;
 static	uint8_t	emergency_status, sent_authen_msg;
-static 	uint16_t timer_cnt = 0, timer_cnt_1s = 0;		// use for multiple timer events
+static	sched_task_t	heartbeat_task, sensor_task, join_task;		// periodic work, each on its own deadline
 static	uint32_t random_delay;
 
+/* change-driven telemetry: the readings since the last report, env_db as last reported */
+static	uint16_t		sensor_ring[SENSOR_RING_LEN][SENSOR_FIELDS];
+static	uint8_t			sensor_head, sensor_n;
+static	env_struct_t	env_sent;
+static	uint8_t			env_sent_valid;
+static	uint16_t		telemetry_silence;			// seconds since env_sent
+static	uint16_t		telemetry_sent, telemetry_skipped;
+static	sensor_agg_t	tele_ref, tele_pending;		// report acked by the BR, report in flight
+static	uint16_t		tele_pending_seq;
+static	uint8_t			tele_ref_valid, tele_pending_valid, tele_ref_base;
+
+/* async TX queue: urgent msgs first; a msg stays until its ACK (MSG_TYPE_ASYNC_ACK)
+   or its last retransmission times out */
+typedef struct {
+	cmd_struct_t	msg;		/* in clear, encrypted into reply at each transmission */
+	uint8_t			enc;
+	uint8_t			urgent;
+	uint8_t			num_tx;		/* transmissions done, > 0: in flight */
+	clock_time_t	start;		/* next transmission at start + wait */
+	clock_time_t	wait;
+	clock_time_t	rto;
+} async_item_t;
+
+static	async_item_t	async_q[ASYNC_QUEUE_LEN];
+static	uint8_t			async_q_len;
+static	struct	ctimer	async_ct;
+
 
 /* define prototype of fucntion call */
 static 	void set_connection_address(uip_ipaddr_t *ipaddr);
+#if SLS_MULTICAST
+static 	void join_group(void);
+#endif
 static 	void get_radio_parameter(void);
 static 	void init_default_parameters(void);
-static 	void reset_reply_parameters(void);
 static 	uint32_t rand_delay();
 static	void show_configuration();
 
@@ -143,24 +230,29 @@ static 	int uart0_input_byte(unsigned char c);
 /*sensor define */
 #endif 
 
-static 	void send_cmd_to_uart();
+static 	void send_cmd_to_uart(const cmd_struct_t *cmd);
 
-static	void process_hello_cmd(cmd_struct_t command);
-static	void print_cmd(cmd_struct_t command);
-static	void print_cmd_data(cmd_struct_t command);
+static	void print_cmd(const cmd_struct_t *command);
+static	void print_cmd_data(const cmd_struct_t *command);
 
-static 	void send_reply (cmd_struct_t res, uint8_t encryption_en);
+static 	void send_reply (uint8_t encryption_en);
+static 	void send_cached_reply (const cmd_struct_t *req);
+static 	void send_frame (const uint8_t *frame, uint8_t frame_len);
 static	void blink_led (unsigned char led);
-static 	uint8_t is_cmd_of_nw (cmd_struct_t cmd);
-static 	uint8_t is_cmd_of_led(cmd_struct_t cmd);
-static 	void send_asyn_msg(uint8_t encryption_en);
+static 	uint8_t queue_asyn_msg(uint8_t encryption_en, uint8_t urgent);
+static 	void send_asyn_msg(void *ptr);
+static 	void ack_asyn_msg(uint16_t seq);
+static 	void sensor_ring_put(void);
+static 	void send_telemetry(void);
 static 	void get_next_hop_addr();
 static 	uint8_t is_connected();
 static 	void reset_sequence();
+static 	void peer_reset_session(peer_t *p);
 
 
 static	uint8_t encryption_phase;
 static	uint8_t sent_app_key_ack;
+static	ccm_session_t async_ccm;		/* session of the async msgs: follows net_db.app_code */
 
 
 /* if using CC2538DK-SHIELD */
@@ -186,24 +278,22 @@ static void init_default_parameters(void) {
 	gw_db.power		= 150;
 	gw_db.status	= GW_CONNECTED; 
 
-	cmd.sfd  = SFD;
-	cmd.seq	 = 0;
-	cmd.type = MSG_TYPE_REP;
-	cmd.len  = sizeof(cmd_struct_t);
-
 	net_db.panid 	= SLS_PAN_ID;
 	net_db.connected = FALSE;
 	net_db.lost_connection_cnt = 0;
 	net_db.authenticated = FALSE;
+	net_db.node_addr = (linkaddr_node_addr.u8[LINKADDR_SIZE-2] << 8) | linkaddr_node_addr.u8[LINKADDR_SIZE-1];
+	net_db.groups = (net_db.node_addr & 1) ? GROUP_ODD : GROUP_EVEN;
 
 	emergency_status = DEFAULT_EMERGENCY_STATUS;
 	encryption_phase = FALSE;
 	sent_authen_msg = FALSE;
 	sent_app_key_ack = FALSE;
 
-	curr_seq = 0;
+	memset(peers, 0, sizeof(peers));
 	new_seq = 0;
 	async_seq = 0;
+	async_q_len = 0;
 
 	memset(&env_db, 0,sizeof(env_db));
 
@@ -215,371 +305,637 @@ static void init_default_parameters(void) {
 }
 
 /*---------------------------------------------------------------------------*/
-void print_cmd_data(cmd_struct_t command) {
-	uint8_t i;	
-  	PRINTF(" - Data = [");
-	for (i=0; i<MAX_CMD_DATA_LEN; i++) {PRINTF("%02X",command.arg[i]); }
-  	PRINTF("]\n");
+void print_cmd_data(const cmd_struct_t *command) {
+	LOG_HEX(EV_RX_DATA, command->arg, MAX_CMD_DATA_LEN);
 }
 
 /*---------------------------------------------------------------------------*/
-static void make_packet_for_node(cmd_struct_t *cmd, uint8_t* key, uint8_t encryption_en) {
+static void make_packet_for_node(cmd_struct_t *cmd, uint8_t* key, const ccm_session_t *ses, uint8_t encryption_en) {
 	if (encryption_en==TRUE) {
-    	PRINTF(" - Key = "); phex_16((uint8_t*)key);
-		encrypt_payload(cmd, key);
+		/* CCM: the MIC takes the place of the CRC */
+		if (ENCRYPTION_MODE!=3) {
+			gen_crc_for_cmd(cmd);
+		}
+		LOG_HEX(EV_KEY, key, 16);
+		encrypt_payload(cmd, key, ses);
 	} else {
-	    PRINTF(" - Encryption:... DISABLED \n");    
+		gen_crc_for_cmd(cmd);
+		LOG0(EV_TX_PLAIN);
 	}
 }
 
 /*---------------------------------------------------------------------------*/
-static void check_packet_for_node(cmd_struct_t *cmd, uint8_t* key, uint8_t encryption_en) {
+/* decrypt and verify the packet in place; return FALSE if it must be dropped:
+   too short, bad MIC (ENCRYPTION_MODE 3) or bad CRC. rx_secured tells whether it
+   came encrypted with key, rather than in clear */
+static uint8_t check_packet_for_node(cmd_struct_t *cmd, uint16_t len, uint8_t* key, const ccm_session_t *ses, uint8_t encryption_en) {
+	uint8_t sfd = cmd->sfd;
+
+	rx_secured = FALSE;
+
+	/* a compact frame is expanded to cmd_struct_t in place: uip_buf has room after uip_appdata */
+	if ((sfd == SFD_COMPACT) || (sfd == SFD_COMPACT_CCM)) {
+		if (parse_compact_frame(cmd, (uint8_t *)cmd, len, key, ses, encryption_en)==FALSE) {
+			LOG(EV_RX_BAD_COMPACT, len);
+			return FALSE;
+		}
+		rx_secured = (sfd == SFD_COMPACT_CCM);
+		return TRUE;
+	}
+
+	if (len < MAX_CMD_LEN) {
+		LOG(EV_RX_SHORT, len);
+		return FALSE;
+	}
+
+	/* a CCM frame carries a MIC instead of the CRC: valid only once the MIC is verified.
+	   In the other modes SFD_CCM is just a ciphertext byte, the CRC is checked below */
+	if ((ENCRYPTION_MODE==3) && (cmd->sfd == SFD_CCM)) {
+		LOG(EV_RX_ENCRYPTED, cmd->sfd);
+		if ((encryption_en==FALSE) || (decrypt_payload(cmd, key, ses)==FALSE)) {
+			LOG0(EV_RX_BAD_MIC);
+			return FALSE;
+		}
+		rx_secured = TRUE;
+		return TRUE;
+	}
+
 	if (cmd->sfd != SFD) {
-	    PRINTF(" - Maybe received packate is encrypted: SPF = 0x%02X \n",cmd->sfd);   
-		if (encryption_en==TRUE)
-			decrypt_payload(cmd, key);
+		LOG(EV_RX_ENCRYPTED, cmd->sfd);
+		if (encryption_en==TRUE) {
+			if (decrypt_payload(cmd, key, ses)==FALSE) {
+				LOG0(EV_RX_BAD_MIC);
+				return FALSE;
+			}
+		}	
 		else
-	    	PRINTF(" - Decryption:... DISABLED \n");   
+			LOG0(EV_RX_DECRYPT_OFF);
 	}
 	else{
-	    PRINTF(" - Received packate is NOT encrypted \n");   
+		LOG0(EV_RX_CLEAR);
 	}
+
+	if (check_crc_for_cmd(cmd)==FALSE) {
+		LOG0(EV_RX_BAD_CRC);
+		return FALSE;
+	}
+	rx_secured = ((sfd != SFD) && (encryption_en==TRUE));
+	return TRUE;
 }
 
 
 /*---------------------------------------------------------------------------*/
-static void process_req_cmd(cmd_struct_t cmd){
+/* Network commands (0xE0..0xFF) are dispatched through cmd_table, indexed by
+   cmd - CMD_TABLE_FIRST. A command without CMD_F_NW goes to the LED-driver. */
+typedef void (*cmd_handler_t)(const cmd_struct_t *cmd);
+
+typedef struct {
+	cmd_handler_t	req;		/* MSG_TYPE_REQ; NULL: ERR_UNKNOWN_CMD */
+	cmd_handler_t	hello;		/* MSG_TYPE_HELLO, any state; NULL: ERR_IN_HELLO_STATE in STATE_HELLO */
+	uint8_t			states;		/* states in which req runs, STATE_BIT() mask */
+	uint8_t			flags;
+} cmd_entry_t;
+
+#define STATE_BIT(s)		(1 << (s))
+#define CMD_F_NW			0x01		/* handled here, not sent to the LED-driver */
+#define CMD_F_NO_SEQ		0x02		/* REQ is processed without the sequence check */
+#define CMD_F_NO_BUNDLE		0x04		/* not allowed in a bundle */
+#define CMD_F_NO_GROUP		0x08		/* not allowed in a group msg: needs the session of the sender */
+
+#define CMD_TABLE_FIRST		CMD_SET_GROUP
+#define CMD_TABLE_SIZE		(0x100 - CMD_TABLE_FIRST)
+
+/*---------------------------------------------------------------------------*/
+// reply.arg[2..17]: radio, security and next hop info
+static void put_nw_info(void) {
 	uint16_t rssi_sent, i;
 
-	reply = cmd;
-	reply.type =  MSG_TYPE_REP;
-	reply.err_code = ERR_NORMAL;
-	PRINTF("Process REQ ....\n");
-	if (state==STATE_NORMAL) {
-		switch (cmd.cmd) {
-			case CMD_RF_HELLO:
-				//leds_on(RED);
-				//PRINTF ("Execute CMD = %s\n",SLS_LED_ON);
-				break;
-			case CMD_RF_AUTHENTICATE:
-				break;
-
-			case CMD_RF_LED_ON:
-				leds_on(BLUE);
-				led_db.status = STATUS_LED_ON;
-				PRINTF(" - Execute CMD = 0x%02X \n",CMD_RF_LED_ON);
-
-				set_led_cc2538_shield(1);
-				break;
-
-			case CMD_RF_LED_OFF:
-				leds_off(BLUE);
-				led_db.status = STATUS_LED_OFF;
-				PRINTF(" - Execute CMD = 0x%02X \n",CMD_RF_LED_ON);
-
-				set_led_cc2538_shield(0);
-				break;
-
-			case CMD_RF_LED_DIM:
-				leds_toggle(BLUE);
-				led_db.status = STATUS_LED_DIM;
-				led_db.dim = cmd.arg[0];			
-				PRINTF (" - Execute CMD = 0x%02X; value = %d\n",CMD_LED_DIM, led_db.dim);
-				break;
-
-			case CMD_GET_RF_STATUS:
-				reply.arg[0] = led_db.id;
-				reply.arg[1] = led_db.power;
-				reply.arg[2] = led_db.temperature;
-				reply.arg[3] = led_db.dim; 
-				reply.arg[4] = led_db.status;
-				break;
-
-			/* network commands */				
-			case CMD_RF_REBOOT:
-				send_reply(reply, encryption_phase);
-				clock_delay(50000);
-				watchdog_reboot();
-				break;
-
-			case CMD_GET_NW_STATUS:
-				reply.arg[0] = 0;
-				reply.arg[1] = NETSTACK_CONF_RDC_CHANNEL_CHECK_RATE;
-				reply.arg[2] = net_db.channel;
-				rssi_sent = net_db.rssi + 150;
-				PRINTF(" - rssi_sent = %d \n", rssi_sent);
-				reply.arg[3] = (rssi_sent & 0xFF);	
-				reply.arg[4] = net_db.lqi;
-				reply.arg[5] = net_db.tx_power; 
-				reply.arg[6] = (net_db.panid >> 8);
-				reply.arg[7] = (net_db.panid) & 0xFF;	
-	
-				reply.arg[8] = (SECURITY_EN << 4) | NONCORESEC_CONF_SEC_LVL;
-				reply.arg[9] = ENCRYPTION_MODE;
+	reply.arg[2] = net_db.channel;
+	rssi_sent = net_db.rssi + 150;
+	LOG(EV_RSSI_SENT, rssi_sent);
+	reply.arg[3] = (rssi_sent & 0xFF);	
+	reply.arg[4] = net_db.lqi;
+	reply.arg[5] = net_db.tx_power; 
+	reply.arg[6] = (net_db.panid >> 8);
+	reply.arg[7] = (net_db.panid) & 0xFF;	
+
+	reply.arg[8] = (SECURITY_EN << 4) | NONCORESEC_CONF_SEC_LVL;
+	reply.arg[9] = ENCRYPTION_MODE;
+
+	// add next hop: only last 8 bytes, because first 8 bytes are FE80::0
+	for (i=0; i<8; i++) {
+		reply.arg[10+i] = net_db.next_hop[8+i];
+	}
+	reply.arg[18] = (net_db.groups >> 8);
+	reply.arg[19] = (net_db.groups) & 0xFF;
+}
 
-				// add next hop: only last 8 bytes, because first 8 bytes are FE80::0
-				for (i=0; i<8; i++) {
-					reply.arg[10+i] = net_db.next_hop[8+i];
-				}
+/*---------------------------------------------------------------------------*/
+static void req_none(const cmd_struct_t *cmd) {
+}
 
-				break;
+/*---------------------------------------------------------------------------*/
+static void req_led_on(const cmd_struct_t *cmd) {
+	leds_on(BLUE);
+	led_db.status = STATUS_LED_ON;
+	LOG(EV_EXEC, CMD_RF_LED_ON);
 
-			case CMD_GET_GW_STATUS:
-				break;
+	set_led_cc2538_shield(1);
+}
 
-			case CMD_GET_APP_KEY:
-				memcpy(&reply.arg,&net_db.app_code,16);
-				break;
+/*---------------------------------------------------------------------------*/
+static void req_led_off(const cmd_struct_t *cmd) {
+	leds_off(BLUE);
+	led_db.status = STATUS_LED_OFF;
+	LOG(EV_EXEC, CMD_RF_LED_OFF);
 
-			case CMD_RF_REPAIR_ROUTE:
-				rpl_repair_root(RPL_DEFAULT_INSTANCE);
-				break;
+	set_led_cc2538_shield(0);
+}
 
-			default:
-				reply.err_code = ERR_UNKNOWN_CMD;			
-		}
-	} 
-	else if (state==STATE_HELLO) {
-		reply = cmd;	
+/*---------------------------------------------------------------------------*/
+static void req_led_dim(const cmd_struct_t *cmd) {
+	leds_toggle(BLUE);
+	led_db.status = STATUS_LED_DIM;
+	led_db.dim = cmd->arg[0];			
+	LOG(EV_EXEC_DIM, CMD_LED_DIM, led_db.dim);
+}
+
+/*---------------------------------------------------------------------------*/
+static void req_get_rf_status(const cmd_struct_t *cmd) {
+	reply.arg[0] = led_db.id;
+	reply.arg[1] = led_db.power;
+	reply.arg[2] = led_db.temperature;
+	reply.arg[3] = led_db.dim; 
+	reply.arg[4] = led_db.status;
+}
+
+/*---------------------------------------------------------------------------*/
+static void req_reboot(const cmd_struct_t *cmd) {
+	send_reply(cur_peer->authenticated);
+	clock_delay(50000);
+	watchdog_reboot();
+}
+
+/*---------------------------------------------------------------------------*/
+static void req_get_nw_status(const cmd_struct_t *cmd) {
+	reply.arg[0] = 0;
+	reply.arg[1] = NETSTACK_CONF_RDC_CHANNEL_CHECK_RATE;
+	put_nw_info();
+}
+
+/*---------------------------------------------------------------------------*/
+static void req_get_app_key(const cmd_struct_t *cmd) {
+	memcpy(&reply.arg,&cur_peer->app_code,16);
+}
+
+/*---------------------------------------------------------------------------*/
+static void req_repair_route(const cmd_struct_t *cmd) {
+	rpl_repair_root(RPL_DEFAULT_INSTANCE);
+}
+
+/*---------------------------------------------------------------------------*/
+// only in a frame decrypted with the app key of an authenticated session, never in clear.
+// ENCRYPTION_MODE 0 has no app-layer encryption: the key comes in clear like any command
+static void req_set_group_key(const cmd_struct_t *cmd) {
+	if ((ENCRYPTION_MODE != 0) && ((cur_peer->authenticated == FALSE) || (rx_secured == FALSE))) {
 		reply.err_code = ERR_IN_HELLO_STATE;
+	} else {
+		memcpy(group_key, cmd->arg, 16);
+		group_key_valid = TRUE;
+		seq_window_reset(&group_window);
+		LOG0(EV_GROUP_KEY);
+	}
+	memset(reply.arg, 0, MAX_CMD_DATA_LEN);		// not echoed back
+}
+
+/*---------------------------------------------------------------------------*/
+static void req_set_group(const cmd_struct_t *cmd) {
+	net_db.groups = (cmd->arg[0] << 8) | cmd->arg[1];
+	LOG(EV_GROUP_SET, net_db.groups);
+}
+
+/*---------------------------------------------------------------------------*/
+static void hello_hello(const cmd_struct_t *cmd) {
+	if (state==STATE_HELLO) {
+		leds_off(RED);
 	}
-	
 }
 
 /*---------------------------------------------------------------------------*/
-static void process_hello_cmd(cmd_struct_t command){
-	uint16_t rssi_sent, i;	
+static void hello_authenticate(const cmd_struct_t *cmd) {
 	uint32_t tem;
+	uint16_t salt;
+
+	tem = (cmd->arg[0] << 8) | cmd->arg[1];
+	net_db.challenge_code = tem & 0xFFFF;
+	net_db.challenge_code_res = hash(net_db.challenge_code);
+	LOG(EV_CHALLENGE, net_db.challenge_code, net_db.challenge_code_res);
+
+	reply.arg[0] = (net_db.challenge_code_res >> 8 ) & 0xFF;
+	reply.arg[1] = (net_db.challenge_code_res) & 0xFF;
+	put_nw_info();
+
+	sent_authen_msg = TRUE;
+	reset_sequence();
+	peer_reset_session(cur_peer);
+
+	/* the seqs restart, the app key may not change: fresh CCM nonces for the session */
+	salt = random_rand();
+	reply.arg[20] = (salt >> 8) & 0xFF;
+	reply.arg[21] = salt & 0xFF;
+	memcpy(cur_peer->ccm.node, &linkaddr_node_addr.u8[LINKADDR_SIZE-CCM_NODE_LEN], CCM_NODE_LEN);
+	cur_peer->ccm.salt[0] = (net_db.challenge_code >> 8) & 0xFF;
+	cur_peer->ccm.salt[1] = net_db.challenge_code & 0xFF;
+	cur_peer->ccm.salt[2] = reply.arg[20];
+	cur_peer->ccm.salt[3] = reply.arg[21];
+
+	/* async msgs to the BR follow the controller that authenticates last */
+	net_db.authenticated = FALSE;
+	encryption_phase = FALSE;				
 
-	get_radio_parameter();
-	reply = command;
-	reply.type =  MSG_TYPE_HELLO;
-	reply.err_code = ERR_NORMAL;
+	leds_off(GREEN);
+	if (state!=STATE_HELLO) {
+		leds_on(GREEN);
+	}
+}
 
-	if (state==STATE_HELLO) {
-		switch (command.cmd) {
-
-			case CMD_RF_HELLO:
-				leds_off(RED);
-				break;
-
-			case CMD_RF_AUTHENTICATE: 
-				tem = (command.arg[0] << 8) | command.arg[1];
-				net_db.challenge_code = tem & 0xFFFF;
-				net_db.challenge_code_res = hash(net_db.challenge_code);
-				PRINTF(" - challenge_code = 0x%04X, challenge_res  = 0x%04X \n", net_db.challenge_code, net_db.challenge_code_res);
-
-				reply.arg[0] = (net_db.challenge_code_res >> 8 ) & 0xFF;
-				reply.arg[1] = (net_db.challenge_code_res) & 0xFF;
-
-				reply.arg[2] = net_db.channel;
-				rssi_sent = net_db.rssi + 150;
-				PRINTF(" - rssi_sent = %d \n", rssi_sent);
-				reply.arg[3] = (rssi_sent & 0xFF);	
-				reply.arg[4] = net_db.lqi;
-				reply.arg[5] = net_db.tx_power; 
-				reply.arg[6] = (net_db.panid >> 8);
-				reply.arg[7] = (net_db.panid) & 0xFF;	
-	
-				reply.arg[8] = SECURITY_EN;
-				reply.arg[8] = (reply.arg[8] << 4) | NONCORESEC_CONF_SEC_LVL;
-				reply.arg[9] = ENCRYPTION_MODE;
+/*---------------------------------------------------------------------------*/
+static void hello_set_app_key(const cmd_struct_t *cmd) {
+	state = STATE_NORMAL;
+	memcpy(&cur_peer->app_code,&cmd->arg,16);
+	cur_peer->authenticated = TRUE;
+	memcpy(&net_db.app_code,&cmd->arg,16);
+	async_ccm = cur_peer->ccm;
+	set_app_key(net_db.app_code);
+	net_db.authenticated = TRUE;
+	env_sent_valid = FALSE;				// the new session starts with a full report
+	tele_ref_valid = FALSE;
+	tele_pending_valid = FALSE;
+	encryption_phase = net_db.authenticated;
+	sent_app_key_ack = TRUE;
+	env_db.id = reply.arg[16];
+
+	LOG(EV_APP_KEY, state);
+	LOG_HEX(EV_KEY, net_db.app_code, 16);
+	LOG(EV_APP_ID, encryption_phase, env_db.id);
+
+	leds_on(GREEN);
+}
 
-				// add next hop: only last 8 bytes, because first 8 bytes are FE80::0
-				for (i=0; i<8; i++) {
-					reply.arg[10+i] = net_db.next_hop[8+i];
-				}
+/*---------------------------------------------------------------------------*/
+#define ENTRY(c)	[(c) - CMD_TABLE_FIRST]
+
+static const cmd_entry_t cmd_table[CMD_TABLE_SIZE] = {
+	ENTRY(CMD_GET_RF_STATUS)	= {req_get_rf_status,	NULL,				STATE_BIT(STATE_NORMAL),	CMD_F_NW},
+	ENTRY(CMD_GET_NW_STATUS)	= {req_get_nw_status,	NULL,				STATE_BIT(STATE_NORMAL),	CMD_F_NW},
+	ENTRY(CMD_RF_LED_OFF)		= {req_led_off,			NULL,				STATE_BIT(STATE_NORMAL),	CMD_F_NW},
+	ENTRY(CMD_RF_LED_ON)		= {req_led_on,			NULL,				STATE_BIT(STATE_NORMAL),	CMD_F_NW},
+	ENTRY(CMD_RF_LED_DIM)		= {req_led_dim,			NULL,				STATE_BIT(STATE_NORMAL),	CMD_F_NW},
+	ENTRY(CMD_RF_HELLO)			= {req_none,			hello_hello,		STATE_BIT(STATE_NORMAL),	CMD_F_NW},
+	ENTRY(CMD_RF_TIMER_ON)		= {NULL,				NULL,				STATE_BIT(STATE_NORMAL),	CMD_F_NW},
+	ENTRY(CMD_RF_TIMER_OFF)		= {NULL,				NULL,				STATE_BIT(STATE_NORMAL),	CMD_F_NW},
+	ENTRY(CMD_SET_APP_KEY)		= {NULL,				hello_set_app_key,	STATE_BIT(STATE_NORMAL),	CMD_F_NW | CMD_F_NO_SEQ},
+	ENTRY(CMD_GET_APP_KEY)		= {req_get_app_key,		NULL,				STATE_BIT(STATE_NORMAL),	CMD_F_NW | CMD_F_NO_GROUP},
+	ENTRY(CMD_RF_REBOOT)		= {req_reboot,			NULL,				STATE_BIT(STATE_NORMAL),	CMD_F_NW | CMD_F_NO_BUNDLE | CMD_F_NO_GROUP},
+	ENTRY(CMD_RF_REPAIR_ROUTE)	= {req_repair_route,	NULL,				STATE_BIT(STATE_NORMAL),	CMD_F_NW},
+	ENTRY(CMD_RF_AUTHENTICATE)	= {req_none,			hello_authenticate,	STATE_BIT(STATE_NORMAL),	CMD_F_NW | CMD_F_NO_SEQ},
+	ENTRY(CMD_SET_GROUP_KEY)	= {req_set_group_key,	NULL,				STATE_BIT(STATE_NORMAL),	CMD_F_NW | CMD_F_NO_GROUP},
+	ENTRY(CMD_SET_GROUP)		= {req_set_group,		NULL,				STATE_BIT(STATE_NORMAL),	CMD_F_NW | CMD_F_NO_GROUP},
+};
 
-				sent_authen_msg = TRUE;
-				reset_sequence();
-				net_db.authenticated = FALSE;
-				encryption_phase = FALSE;				
-
-				leds_off(GREEN);
-				break;
-
-			case CMD_SET_APP_KEY:
-				state = STATE_NORMAL;
-				memcpy(&net_db.app_code,&cmd.arg,16);
-				net_db.authenticated = TRUE;
-				encryption_phase = net_db.authenticated;
-				sent_app_key_ack = TRUE;
-				env_db.id = reply.arg[16];
-
-				PRINTF("In state = %d, got the APP_KEY: authenticated \n", state);
-			    PRINTF(" - Key = [");
-    			for (i=0; i<=15; i++) {	PRINTF("%02X ", net_db.app_code[i]);}
-    			PRINTF("]\n");
-				PRINTF(" - encryption_phase =  %d; My APP-ID = %d \n", encryption_phase, env_db.id);				
-
-				leds_on(GREEN);
-				break;
-
-			default:
-				reply.err_code = ERR_IN_HELLO_STATE;
-				break;
-		}	
+/*---------------------------------------------------------------------------*/
+// NULL if the command is not a network command
+static const cmd_entry_t* find_cmd(uint8_t cmd) {
+	const cmd_entry_t *entry;
+
+	if (cmd < CMD_TABLE_FIRST)
+		return NULL;
+	entry = &cmd_table[cmd - CMD_TABLE_FIRST];
+	return (entry->flags & CMD_F_NW) ? entry : NULL;
+}
 
-		
-	} else { // state!=STATE_HELLO
-		switch (command.cmd) {
-			case CMD_RF_HELLO:
-				break;
-
-			case CMD_RF_AUTHENTICATE: 
-				tem = (command.arg[0] << 8) | command.arg[1];
-				net_db.challenge_code = tem & 0xFFFF;
-				net_db.challenge_code_res = hash(net_db.challenge_code);
-				PRINTF(" - challenge_code = 0x%04X, challenge_res  = 0x%04X \n", net_db.challenge_code, net_db.challenge_code_res);
-
-				reply.arg[0] = (net_db.challenge_code_res >> 8 ) & 0xFF;
-				reply.arg[1] = (net_db.challenge_code_res) & 0xFF;
-
-				reply.arg[2] = net_db.channel;
-				rssi_sent = net_db.rssi + 150;
-				PRINTF(" - rssi_sent = %d\n", rssi_sent);
-				reply.arg[3] = (rssi_sent & 0xFF);			
-				reply.arg[4] = net_db.lqi;
-				reply.arg[5] = net_db.tx_power; 
-				reply.arg[6] = (net_db.panid >> 8);
-				reply.arg[7] = (net_db.panid) & 0xFF;	
-
-				reply.arg[8] = (SECURITY_EN << 4) | NONCORESEC_CONF_SEC_LVL;
-				reply.arg[9] = ENCRYPTION_MODE;
-
-				// add next hop: only last 8 bytes, because first 8 bytes are fe80::0
-				for (i=0; i<8; i++) {
-					reply.arg[10+i] = net_db.next_hop[8+i];
-				}
+/*---------------------------------------------------------------------------*/
+// cmd may be reply itself (items of a bundle): handlers read cmd before they write reply
+static void process_req_cmd(const cmd_entry_t *entry, const cmd_struct_t *cmd){
+	if (cmd != &reply)
+		reply = *cmd;
+	reply.type =  MSG_TYPE_REP;
+	reply.err_code = ERR_NORMAL;
+	LOG0(EV_REQ);
+	if (entry->states & STATE_BIT(state)) {
+		if (entry->req != NULL) {
+			entry->req(cmd);
+		} else {
+			reply.err_code = ERR_UNKNOWN_CMD;			
+		}
+	} 
+	else if (state==STATE_HELLO) {
+		if (cmd != &reply)
+			reply = *cmd;
+		reply.err_code = ERR_IN_HELLO_STATE;
+	}
+}
 
-				sent_authen_msg = TRUE;
-				reset_sequence();
-				encryption_phase = FALSE;
-				net_db.authenticated = FALSE;
-				
-				leds_off(GREEN);
-				leds_on(GREEN);
-				break;
+/*---------------------------------------------------------------------------*/
+// run the items of a bundle through process_req_cmd(): each item is decoded into reply, where
+// its handler leaves its result, and the results are packed into cmd_scratch, the reply at the end.
+// A fixed CCM frame carries CCM_DATA_LEN arg bytes only, in both directions
+static void process_bundle(const cmd_struct_t *cmd) {
+	const cmd_entry_t *entry;
+	uint8_t i = 0, o = 0, n = 0, item_len, res_len;
+	uint8_t max_len = ((ENCRYPTION_MODE == 3) && (reply_compact == FALSE)) ? CCM_DATA_LEN : MAX_CMD_DATA_LEN;
+
+	cmd_scratch = *cmd;
+	cmd_scratch.type = MSG_TYPE_REP;
+	cmd_scratch.err_code = ERR_NORMAL;
+	memset(cmd_scratch.arg, 0, MAX_CMD_DATA_LEN);
+
+	while ((i + BUNDLE_ITEM_HDR_LEN <= max_len) && (cmd->arg[i] != 0)) {
+		item_len = cmd->arg[i+1];
+		if (i + BUNDLE_ITEM_HDR_LEN + item_len > max_len) {
+			cmd_scratch.err_code = ERR_BUNDLE_FORMAT;
+			break;
+		}
+		if (o + BUNDLE_RES_HDR_LEN > max_len) {
+			cmd_scratch.err_code = ERR_BUNDLE_OVERFLOW;		// no room to report it: not executed
+			break;
+		}
+		reply = *cmd;
+		reply.type = MSG_TYPE_REQ;
+		reply.cmd = cmd->arg[i];
+		memset(reply.arg, 0, MAX_CMD_DATA_LEN);
+		memcpy(reply.arg, &cmd->arg[i+BUNDLE_ITEM_HDR_LEN], item_len);
+		i += BUNDLE_ITEM_HDR_LEN + item_len;
+
+		entry = find_cmd(reply.cmd);
+		if ((entry == NULL) || (entry->flags & CMD_F_NO_BUNDLE)) {
+			reply.err_code = ERR_UNKNOWN_CMD;
+			res_len = 0;
+		} else {
+			process_req_cmd(entry, &reply);
+			res_len = compact_arg_len(&reply);
+		}
+		if (o + BUNDLE_RES_HDR_LEN + res_len > max_len) {
+			reply.err_code = ERR_BUNDLE_OVERFLOW;	// executed, but its data is left out
+			cmd_scratch.err_code = ERR_BUNDLE_OVERFLOW;
+			res_len = 0;
+		}
+		cmd_scratch.arg[o] = reply.cmd;
+		cmd_scratch.arg[o+1] = reply.err_code;
+		cmd_scratch.arg[o+2] = res_len;
+		memcpy(&cmd_scratch.arg[o+BUNDLE_RES_HDR_LEN], reply.arg, res_len);
+		o += BUNDLE_RES_HDR_LEN + res_len;
+		n++;
+	}
+	reply = cmd_scratch;
+	LOG(EV_BUNDLE, n, cmd_scratch.err_code);
+}
 
-			case CMD_SET_APP_KEY:
-				state = STATE_NORMAL;
-				memcpy(&net_db.app_code,&cmd.arg,16);
-				net_db.authenticated = TRUE;
-				encryption_phase = net_db.authenticated;
+/*---------------------------------------------------------------------------*/
+// a group msg runs through cmd_table like a REQ, on the nodes of the groups it addresses.
+// CMD_GW_MULTICAST_CMD/CMD_GW_BROADCAST_CMD carry the command in arg[0], CMD_GW_GROUP_CMD
+// the group mask in arg[0..1] and the command in arg[2]; its args follow
+static void process_group_cmd(const cmd_struct_t *cmd) {
+	const cmd_entry_t *entry;
+	uint16_t to = 0xFFFF;
+	uint8_t hdr = 0;
+
+	cmd_scratch = *cmd;
+	switch (cmd->cmd) {
+	case CMD_GW_TURN_ON_ALL:	cmd_scratch.cmd = CMD_RF_LED_ON;						break;
+	case CMD_GW_TURN_OFF_ALL:	cmd_scratch.cmd = CMD_RF_LED_OFF;						break;
+	case CMD_GW_DIM_ALL:		cmd_scratch.cmd = CMD_RF_LED_DIM;						break;
+	case CMD_GW_TURN_ON_ODD:	cmd_scratch.cmd = CMD_RF_LED_ON;	to = GROUP_ODD;		break;
+	case CMD_GW_TURN_ON_EVEN:	cmd_scratch.cmd = CMD_RF_LED_ON;	to = GROUP_EVEN;	break;
+	case CMD_GW_TURN_OFF_ODD:	cmd_scratch.cmd = CMD_RF_LED_OFF;	to = GROUP_ODD;		break;
+	case CMD_GW_TURN_OFF_EVEN:	cmd_scratch.cmd = CMD_RF_LED_OFF;	to = GROUP_EVEN;	break;
+	case CMD_GW_DIM_ODD:		cmd_scratch.cmd = CMD_RF_LED_DIM;	to = GROUP_ODD;		break;
+	case CMD_GW_DIM_EVEN:		cmd_scratch.cmd = CMD_RF_LED_DIM;	to = GROUP_EVEN;	break;
+	case CMD_GW_MULTICAST_CMD:
+	case CMD_GW_BROADCAST_CMD:
+		hdr = 1;
+		break;
+	case CMD_GW_GROUP_CMD:
+		to = (cmd->arg[0] << 8) | cmd->arg[1];
+		hdr = 3;
+		break;
+	}
+	if ((to & net_db.groups) == 0) {
+		LOG(EV_GROUP_SKIP, to);
+		return;
+	}
+	if (hdr > 0) {
+		cmd_scratch.cmd = cmd->arg[hdr-1];
+		memmove(cmd_scratch.arg, &cmd->arg[hdr], MAX_CMD_DATA_LEN-hdr);
+		memset(&cmd_scratch.arg[MAX_CMD_DATA_LEN-hdr], 0, hdr);
+	}
+	LOG(EV_GROUP_RX, cmd->seq, cmd_scratch.cmd);
 
-				sent_app_key_ack = TRUE;				
-				env_db.id = reply.arg[16];
+	entry = find_cmd(cmd_scratch.cmd);
+	if (entry == NULL) {
+		if (state==STATE_NORMAL) {
+			send_cmd_to_uart(&cmd_scratch);
+		}
+	} else if ((entry->flags & CMD_F_NO_GROUP) == 0) {
+		process_req_cmd(entry, &cmd_scratch);
+	}
+}
 
-				PRINTF("In state = %d, got the APP_KEY: authenticated \n", state);
-			    PRINTF(" - Key = [");
-    			for (i=0; i<=15; i++) {	PRINTF("%02X ", net_db.app_code[i]);}
-    			PRINTF("]\n");
-				PRINTF(" - encryption_phase =  %d; My APP-ID = %d \n", encryption_phase, env_db.id);				
+/*---------------------------------------------------------------------------*/
+// frames to SLS_MULTICAST_PORT: no session and no reply, one seq window for the group
+static void group_handler(cmd_struct_t *rx) {
+	uint8_t clear = ((rx->sfd == SFD) || (rx->sfd == SFD_COMPACT));
+
+	if (((ENCRYPTION_MODE != 0) && ((group_key_valid == FALSE) || (clear == TRUE))) ||
+		(check_packet_for_node(rx, len, group_key, &group_ccm, group_key_valid)==FALSE) ||
+		(rx->type != MSG_TYPE_REQ)) {
+		LOG0(EV_RX_DROP);
+		return;
+	}
+	if (seq_window_check(&group_window, rx->seq)==FALSE) {
+		LOG(EV_RX_REPLAY, rx->seq);
+		return;
+	}
+	blink_led(GREEN);
+	process_group_cmd(rx);
+}
 
-				leds_on(GREEN);
-				break;			
+/*---------------------------------------------------------------------------*/
+static peer_t* find_peer(const uip_ipaddr_t *addr) {
+	uint8_t i;
 
-			// other command processing here		
+	for (i=0; i<PEER_TABLE_LEN; i++) {
+		if ((peers[i].used == TRUE) && uip_ipaddr_cmp(&peers[i].addr, addr)) {
+			return &peers[i];
 		}
 	}
+	return NULL;
 }
 
+/*---------------------------------------------------------------------------*/
+// new session for addr; a full table gives up the least recently used one, unauthenticated first
+static peer_t* add_peer(const uip_ipaddr_t *addr) {
+	peer_t *p = NULL;
+	uint8_t i;
+
+	for (i=0; i<PEER_TABLE_LEN; i++) {
+		if (peers[i].used == FALSE) {
+			p = &peers[i];
+			break;
+		}
+		if ((p == NULL) || (peers[i].authenticated < p->authenticated) ||
+			((peers[i].authenticated == p->authenticated) &&
+			 ((uint16_t)(peer_clock - peers[i].last_used) > (uint16_t)(peer_clock - p->last_used)))) {
+			p = &peers[i];
+		}
+	}
+	memset(p, 0, sizeof(peer_t));
+	uip_ipaddr_copy(&p->addr, addr);
+	p->used = TRUE;
+	LOG(EV_PEER_NEW, UIP_HTONS(addr->u16[6]), UIP_HTONS(addr->u16[7]), (uint16_t)(p - peers));
+	return p;
+}
 
 /*---------------------------------------------------------------------------*/
-static uint8_t is_cmd_of_nw (cmd_struct_t cmd) {
-	return  (cmd.cmd==CMD_GET_RF_STATUS) ||
-			(cmd.cmd==CMD_GET_NW_STATUS) ||
-			(cmd.cmd==CMD_RF_HELLO) ||
-			(cmd.cmd==CMD_RF_LED_ON) ||
-			(cmd.cmd==CMD_RF_LED_OFF) ||
-			(cmd.cmd==CMD_RF_LED_DIM) ||			
-			(cmd.cmd==CMD_RF_TIMER_ON) ||			
-			(cmd.cmd==CMD_RF_TIMER_OFF) ||			
-			(cmd.cmd==CMD_SET_APP_KEY) ||		
-			(cmd.cmd==CMD_GET_APP_KEY) ||	
-			(cmd.cmd==CMD_RF_REBOOT) ||		
-			(cmd.cmd==CMD_RF_REPAIR_ROUTE) ||
-			(cmd.cmd==CMD_RF_AUTHENTICATE);		
+static void peer_reset_session(peer_t *p) {
+	seq_window_reset(&p->window);
+	reply_cache_reset(&p->cache);
+	p->authenticated = FALSE;
 }
 
 
-/*----------------------------------------------------------------------*/
-static uint8_t is_cmd_of_led (cmd_struct_t cmd) {
-	return !is_cmd_of_nw(cmd);
+/*---------------------------------------------------------------------------*/
+static void process_hello_cmd(const cmd_entry_t *entry, const cmd_struct_t *command){
+	get_radio_parameter();
+	reply = *command;
+	reply.type =  MSG_TYPE_HELLO;
+	reply.err_code = ERR_NORMAL;
+
+	if (entry->hello != NULL) {
+		entry->hello(command);
+	} else if (state==STATE_HELLO) {
+		reply.err_code = ERR_IN_HELLO_STATE;
+	}
 }
 
 
 /*----------------------------------------------------------------------*/
-void print_cmd(cmd_struct_t cmd) {
-	PRINTF(" - Rx CMD-struct: sfd=0x%02X; len=%d; seq=%d; type=0x%02X; cmd=0x%02X; err_code=0x%04X\n",
-							cmd.sfd, cmd.len, cmd.seq, cmd.type, cmd.cmd, cmd.err_code);
+void print_cmd(const cmd_struct_t *cmd) {
+	LOG(EV_RX_CMD, cmd->sfd, cmd->len, cmd->seq, cmd->type, cmd->cmd, cmd->err_code);
 }
 
 /*----------------------------------------------------------------------*/
 static void tcpip_handler(void)	{
+	cmd_struct_t *rx;
+	const cmd_entry_t *entry;
+	const reply_cache_entry_t *cached;
+	peer_t *peer;
 
-	memset(buf, 0, MAX_PAYLOAD_LEN);
   	if(uip_newdata()) {
-  		blink_led(GREEN);
     	len = uip_datalen();
-    	memcpy(buf, uip_appdata, len);
-    	PRINTF("\n In state = %d, received a packet (%d byte) from [", state, len);
-    	PRINT6ADDR(&UIP_IP_BUF->srcipaddr);
-    	PRINTF("]:%u \n", UIP_HTONS(UIP_UDP_BUF->srcport));
-		
-    	uip_ipaddr_copy(&server_conn->ripaddr, &UIP_IP_BUF->srcipaddr);
-    	server_conn->rport = UIP_UDP_BUF->srcport;
+		LOG(EV_RX_PKT, state, len, UIP_HTONS(UIP_IP_BUF->srcipaddr.u16[6]), UIP_HTONS(UIP_IP_BUF->srcipaddr.u16[7]),
+			UIP_HTONS(UIP_UDP_BUF->srcport));
+
+		/* work on the frame in uip_buf: IPv6, extension and UDP headers are multiples
+		   of 8 bytes, so uip_appdata is aligned for cmd_struct_t */
+		rx = (cmd_struct_t *)uip_appdata;
+
+		/* ACK of an async msg, comes back on client_conn under the async session */
+		if (uip_udp_conn == client_conn) {
+			if ((check_packet_for_node(rx, len, net_db.app_code, &async_ccm, encryption_phase)==TRUE) &&
+				(rx->type==MSG_TYPE_ASYNC_ACK)) {
+				ack_asyn_msg(rx->seq);
+			}
+			return;
+		}
 
-		get_radio_parameter();
-		reset_reply_parameters();
-		
-		//p = &buf;	cmdPtr = (cmd_struct_t *)(&buf);
-		cmd = *(cmd_struct_t *)(&buf);
+		/* command to the whole group */
+		if (uip_udp_conn == mcast_conn) {
+			group_handler(rx);
+			return;
+		}
 
-		// data decryption
-		check_packet_for_node(&cmd, net_db.app_code, encryption_phase);	
+		// data decryption and check with the session of the sender, before any command processing;
+		// an unknown sender gets a session only once its frame is valid
+		peer = find_peer(&UIP_IP_BUF->srcipaddr);
+		reply_compact = ((rx->sfd == SFD_COMPACT) || (rx->sfd == SFD_COMPACT_CCM));
+		if (check_packet_for_node(rx, len, (peer != NULL) ? peer->app_code : NULL, (peer != NULL) ? &peer->ccm : NULL,
+								  (peer != NULL) ? peer->authenticated : FALSE)==FALSE) {
+			LOG0(EV_RX_DROP);
+			return;
+		}
+		if (peer == NULL) {
+			peer = add_peer(&UIP_IP_BUF->srcipaddr);
+		}
+		peer->port = UIP_UDP_BUF->srcport;
+		peer->last_used = ++peer_clock;
+		cur_peer = peer;
 
-		print_cmd(cmd);
-		print_cmd_data(cmd);
+  		blink_led(GREEN);
 
-		/* check CRC of command: no need to check, lower layer will do*/
-		if (check_crc_for_cmd(&cmd)==TRUE) {PRINTF(" - Good CRC \n"); }
-		else {PRINTF(" - Bad CRC \n");}
+		/* a repeated request whose reply was lost: same reply again, not executed twice */
+		cached = reply_cache_find(&cur_peer->cache, rx);
+		if (cached != NULL) {
+			LOG(EV_RX_CACHED, rx->seq);
+			send_frame(cached->frame, cached->frame_len);
+			return;
+		}
 
-		reply = cmd;	// copy cmd to reply for response		
+		get_radio_parameter();
 
-		//process command 
-		new_seq = cmd.seq;
-		PRINTF(" - [new_seq/old_seq] = [%d/%d] \n", new_seq, curr_seq);			
+		print_cmd(rx);
+		print_cmd_data(rx);
+
+		//process command: a reply is built in uip_buf, so rx is not valid after send_reply()
+		new_seq = rx->seq;
+		LOG(EV_RX_SEQ, new_seq, cur_peer->window.top);
+
+		/* several commands under one seq, one reply */
+		if (rx->type==MSG_TYPE_BUNDLE) {
+			reply = *rx;
+			if (seq_window_check(&cur_peer->window, new_seq)==TRUE) {
+				process_bundle(rx);
+			} else {
+				LOG(EV_RX_REPLAY, new_seq);
+			}
+			LOG0(EV_REPLY_NW);
+			send_cached_reply(rx);
+			return;
+		}
+
+		entry = find_cmd(rx->cmd);
+		if (entry != NULL) {
+			reply = *rx;	// copy cmd to reply for response		
 
-		if (is_cmd_of_nw(cmd)) {
 			/* get a REQ */
-			if (cmd.type==MSG_TYPE_REQ) {
-				if ((cmd.cmd == CMD_RF_AUTHENTICATE) || (cmd.cmd == CMD_SET_APP_KEY)) {
+			if (rx->type==MSG_TYPE_REQ) {
+				if (entry->flags & CMD_F_NO_SEQ) {
 					/* do not check sequence */
-					process_req_cmd(cmd);
-				} else if (new_seq > curr_seq) {	// if not duplicate packet
-					process_req_cmd(cmd);
-					curr_seq = new_seq;	
-				}	
+					process_req_cmd(entry, rx);
+				} else if (seq_window_check(&cur_peer->window, new_seq)==TRUE) {	// if not duplicate packet
+					process_req_cmd(entry, rx);
+				} else {
+					LOG(EV_RX_REPLAY, new_seq);
+				}
 				
 			/* get a HELLO, do not check sequence */
-			} else if (cmd.type==MSG_TYPE_HELLO) { 
-				process_hello_cmd(cmd);	
+			} else if (rx->type==MSG_TYPE_HELLO) { 
+				process_hello_cmd(entry, rx);	
 			
 			} 
-			PRINTF("\nReply for NW command: \n");
-			send_reply(reply, encryption_phase);
+			LOG0(EV_REPLY_NW);
+			send_cached_reply(rx);
 		}	
 
 		/* LED command , send command to LED-driver */
-		if (is_cmd_of_led(cmd)){
+		else {
 			if (state==STATE_NORMAL) {
+				send_cmd_to_uart(rx);
 #if defined(SLS_USING_SKY) || defined(SLS_USING_Z1)			/* used for Cooja simulate the reply from LED driver */
-				PRINTF("\nReply for LED-driver command: \n");
-				send_reply(reply, encryption_phase);
+				reply = *rx;
+				LOG0(EV_REPLY_LED);
+				send_cached_reply(rx);
 #endif
-			send_cmd_to_uart();
 			}
 		}	
   	}
@@ -588,16 +944,9 @@ static void tcpip_handler(void)	{
 
 
 /*---------------------------------------------------------------------------*/
+// queued in led_anim.c, returns at once
 static void blink_led(unsigned char led) {
-	int i;
-	for (i=0; i<3; i++) { 
-		leds_toggle(led);
-		//clock_delay_usec((uint16_t)10000000);
-		clock_delay((uint16_t)500000);
-		leds_toggle(led);
-		//clock_delay_usec((uint16_t)10000000);
-		clock_delay((uint16_t)500000);
-	}	
+	led_blink(led, LED_BLINK_NUM, LED_BLINK_PERIOD);
 }
 
 
@@ -617,7 +966,8 @@ static int uart0_input_byte(unsigned char c) {
 				emer_reply.arg[i] = rxbuf[i+1];
 			}
 
-			send_asyn_msg(encryption_phase);
+			/* called from the UART ISR: the msg is sent by the process, which owns reply */
+			process_poll(&udp_echo_server_process);
 		}
 		
 		//if (cmd_cnt==sizeof(cmd_struct_t)) {		/* got the full reply */
@@ -632,7 +982,7 @@ static int uart0_input_byte(unsigned char c) {
 		//	} 
 		//	else if (emer_reply.type == MSG_TYPE_REP) {		//send reply
 		//		reply = emer_reply;
-		//		send_reply(reply, encryption_phase);		/* got a Reply from LED-driver, send to orginal node */
+		//		send_reply(encryption_phase);		/* got a Reply from LED-driver, send to orginal node */
 				//blink_led(GREEN);
 		//	}
 		//}		
@@ -653,35 +1003,27 @@ static unsigned int uart0_send_bytes(const	unsigned  char *s, unsigned int len)
 
 
 /*---------------------------------------------------------------------------*/
-static void send_cmd_to_uart() {
+static void send_cmd_to_uart(const cmd_struct_t *cmd) {
 #ifdef SLS_USING_CC2538DK
-	uart0_send_bytes((const unsigned  char *)(&cmd), sizeof(cmd));	
+	uart0_send_bytes((const unsigned  char *)cmd, sizeof(cmd_struct_t));	
 #endif
 }
 
-/*---------------------------------------------------------------------------*/
-static void reset_reply_parameters(void) {
-	memset(&reply, 0, sizeof(reply));
-}
-
 /*---------------------------------------------------------------------------*/
 static void get_radio_parameter(void) {
 #ifndef SLS_USING_CC2530DK
 	NETSTACK_RADIO.get_value(RADIO_PARAM_CHANNEL, &aux);
 	net_db.channel = (unsigned int) aux;
-	PRINTF(" - CH = %u, ", (unsigned int) aux);	
 
  	aux = packetbuf_attr(PACKETBUF_ATTR_RSSI);
 	net_db.rssi = (int8_t)aux;
- 	PRINTF("RSSI = %d dBm, ", net_db.rssi);
 
 	aux = packetbuf_attr(PACKETBUF_ATTR_LINK_QUALITY);
 	net_db.lqi = aux;
- 	PRINTF("LQI = %u, ", aux);
 
 	NETSTACK_RADIO.get_value(RADIO_PARAM_TXPOWER, &aux);
 	net_db.tx_power = aux;
- 	PRINTF("Tx Power = %d dBm \n", aux);
+	LOG(EV_RADIO, net_db.channel, net_db.rssi, net_db.lqi, net_db.tx_power);
 #endif 	
 }
 
@@ -695,72 +1037,364 @@ static void set_connection_address(uip_ipaddr_t *ipaddr) {
 
 
 /*---------------------------------------------------------------------------*/
-static void send_reply(cmd_struct_t res, uint8_t encryption_en) {
-	cmd_struct_t response;
+#if SLS_MULTICAST
+// listen to SLS_MCAST_GROUP; the multicast engine (project-conf.h) forwards it through the mesh
+static void join_group(void) {
+	uip_ipaddr_t addr;
+
+	SLS_MCAST_GROUP(&addr);
+	if (uip_ds6_maddr_add(&addr) == NULL) {
+		PRINTF("Failed to join the SLS group\n");
+		return;
+	}
+	mcast_conn = udp_new(NULL, UIP_HTONS(0), NULL);
+	if (mcast_conn != NULL) {
+		udp_bind(mcast_conn, UIP_HTONS(SLS_MULTICAST_PORT));
+	}
+}
+#endif /* SLS_MULTICAST */
+
+
+/*---------------------------------------------------------------------------*/
+// sends reply, encrypted in place: reply is not valid afterwards
+static void send_reply(uint8_t encryption_en) {
+	const uint8_t *frame = tx_frame;
+	uint8_t frame_len = 0;
 
-	response = res;
-	gen_crc_for_cmd(&response);
-	make_packet_for_node(&response, net_db.app_code, encryption_en);
+	if (reply_compact == TRUE) {
+		frame_len = make_compact_frame(tx_frame, &reply, compact_arg_len(&reply), cur_peer->app_code, &cur_peer->ccm, encryption_en);
+	}
+	if (frame_len == 0) {
+		make_packet_for_node(&reply, cur_peer->app_code, &cur_peer->ccm, encryption_en);
+		frame = (const uint8_t *)&reply;
+		frame_len = MAX_CMD_LEN;
+	}
 
+	if (reply_slot != NULL) {
+		reply_cache_fill(reply_slot, frame, frame_len);
+		reply_slot = NULL;
+	}
+	send_frame(frame, frame_len);
+}
+
+/*---------------------------------------------------------------------------*/
+// sends the reply to req and keeps it for a repeat of req: only requests that get
+// a reply take a slot of the reply cache, LED-driver commands on CC2538 do not
+static void send_cached_reply(const cmd_struct_t *req) {
+	reply_slot = reply_cache_add(&cur_peer->cache, req);
+	send_reply(cur_peer->authenticated);
+}
+
+/*---------------------------------------------------------------------------*/
+// a frame ready for the air, to the sender of the current request;
+// server_conn stays unbound, so requests from the other peers keep coming in
+static void send_frame(const uint8_t *frame, uint8_t frame_len) {
 	/* echo back to sender */	
-	PRINTF("Reply a msg (%d bytes) to [", sizeof(res));
-	PRINT6ADDR(&UIP_IP_BUF->srcipaddr);
-	PRINTF("]:%u \n", UIP_HTONS(UIP_UDP_BUF->srcport));
-	uip_udp_packet_send(server_conn, &response, sizeof(response));
-
-	/* Restore server connection to allow data from any node */
-	uip_create_unspecified(&server_conn->ripaddr);
-	//memset(&server_conn->ripaddr, 0, sizeof(server_conn->ripaddr));
-	//server_conn->rport = 0;
+	LOG(EV_TX_REPLY, frame_len, UIP_HTONS(cur_peer->addr.u16[6]), UIP_HTONS(cur_peer->addr.u16[7]),
+		UIP_HTONS(cur_peer->port));
+	uip_udp_packet_sendto(server_conn, frame, frame_len, &cur_peer->addr, cur_peer->port);
 	blink_led(GREEN);
 }
 
 /*---------------------------------------------------------------------------*/
 static void reset_sequence(){
 	async_seq 	= 0;
-	curr_seq 	= 0;
 	new_seq 	= 0;
 }
 
 
 /*---------------------------------------------------------------------------*/
-static void send_asyn_msg(uint8_t encryption_en){ 
-	cmd_struct_t response;
+// random delay before an async transmission, spread by the node id
+static clock_time_t async_jitter() {
+	clock_time_t t;
+
+	random_delay = (env_db.id > 0) ? rand_delay() : random_rand();
+	t = 1 + (clock_time_t)(random_delay % ASYNC_JITTER_MAX);
+	LOG(EV_ASYNC_DELAY, (uint16_t)((uint32_t)t*1000/CLOCK_SECOND));
+	return t;
+}
 
 
-	// pass data of env_db to payload	
-	memcpy(&emer_reply.arg, &env_db,sizeof(env_db));
+/*---------------------------------------------------------------------------*/
+static uint8_t async_in_flight() {
+	uint8_t i, n = 0;
+
+	for (i=0; i<async_q_len; i++) {
+		if (async_q[i].num_tx > 0) {
+			n++;
+		}
+	}
+	return n;
+}
+
+
+/*---------------------------------------------------------------------------*/
+static void async_remove(uint8_t i) {
+	async_q_len--;
+	for (; i<async_q_len; i++) {
+		async_q[i] = async_q[i+1];
+	}
+}
+
+
+/*---------------------------------------------------------------------------*/
+// arms the ctimer for the earliest transmission or timeout; new msgs wait for a free window slot
+static void async_schedule() {
+	clock_time_t now = clock_time(), left, next = 0;
+	uint8_t i, found = FALSE, window_open = (async_in_flight() < ASYNC_WINDOW);
+
+	for (i=0; i<async_q_len; i++) {
+		if ((async_q[i].num_tx == 0) && (window_open == FALSE)) {
+			continue;
+		}
+		left = (clock_time_t)(now - async_q[i].start);
+		left = (left >= async_q[i].wait) ? 0 : async_q[i].wait - left;
+		if ((found == FALSE) || (left < next)) {
+			next = left;
+			found = TRUE;
+		}
+	}
+	if (found == TRUE) {
+		ctimer_set(&async_ct, next, send_asyn_msg, NULL);
+	} else {
+		ctimer_stop(&async_ct);
+	}
+}
+
+
+/*---------------------------------------------------------------------------*/
+// puts emer_reply, arg filled by the caller, in the TX queue; urgent msgs go before the waiting ones and may push out the last one
+static uint8_t queue_asyn_msg(uint8_t encryption_en, uint8_t urgent) {
+	uint8_t i;
 
 	//attach rssi if needed
 
-	// no retransmission here
-	if (is_connected()==TRUE) {
-		if ((net_db.authenticated == TRUE) || (emer_reply.cmd == ASYNC_MSG_JOINED)) {		// if authenticated or request Authen
-			async_seq++;
-			emer_reply.sfd = SFD;
-			emer_reply.type = MSG_TYPE_ASYNC;
-			emer_reply.err_code = ERR_NORMAL;
-			emer_reply.seq = async_seq;
-		
-			response = emer_reply;
-			gen_crc_for_cmd(&response);
-			make_packet_for_node(&response, net_db.app_code, encryption_en);
-
-			random_delay = rand_delay();
-			PRINTF(" - Delay a random time = %u ms \n", (uint16_t)((uint32_t)(random_delay*2.83)/1000));
-			clock_delay(random_delay);
-			uip_udp_packet_send(client_conn, &response, sizeof(response));	
-
-			PRINTF("Client sending (%d bytes) ASYNC msg [%d], CMD = 0x%02X, to BR [", sizeof(response), async_seq, emer_reply.cmd);
-			PRINT6ADDR(&client_conn->ripaddr);
-			PRINTF("] \n\n");
+	if (is_connected()==FALSE) {
+		LOG0(EV_ASYNC_NOROUTE);
+		return FALSE;
+	}
+	if ((net_db.authenticated == FALSE) && (emer_reply.cmd != ASYNC_MSG_JOINED)) {		// if authenticated or request Authen
+		LOG(EV_ASYNC_NOAUTH, async_seq);
+		return FALSE;
+	}
+	if ((async_q_len == ASYNC_QUEUE_LEN) && ((urgent == FALSE) || (async_q[async_q_len-1].urgent == TRUE))) {
+		LOG(EV_ASYNC_FULL, emer_reply.cmd);
+		return FALSE;
+	}
+	if (async_q_len == ASYNC_QUEUE_LEN) {
+		LOG(EV_ASYNC_FULL, async_q[async_q_len-1].msg.cmd);
+		async_remove(async_q_len-1);
+	}
+
+	/* the seq is part of the CCM nonce: a new session before it wraps */
+	if ((async_seq == 0xFFFF) && (net_db.authenticated == TRUE)) {
+		LOG(EV_ASYNC_NOAUTH, async_seq);
+		net_db.authenticated = FALSE;
+		sent_authen_msg = FALSE;
+		encryption_phase = FALSE;
+		return FALSE;
+	}
+	async_seq++;
+	emer_reply.sfd = SFD;
+	emer_reply.type = MSG_TYPE_ASYNC;
+	emer_reply.err_code = ERR_NORMAL;
+	emer_reply.seq = async_seq;
+
+	/* msgs in flight keep their place */
+	i = async_q_len;
+	if (urgent == TRUE) {
+		while ((i > 0) && (async_q[i-1].urgent == FALSE) && (async_q[i-1].num_tx == 0)) {
+			async_q[i] = async_q[i-1];
+			i--;
+		}
+	}
+	async_q[i].msg = emer_reply;
+	async_q[i].enc = encryption_en;
+	async_q[i].urgent = urgent;
+	async_q[i].num_tx = 0;
+	async_q[i].start = clock_time();
+	async_q[i].wait = async_jitter();
+	async_q[i].rto = ASYNC_RTO_INIT;
+	async_q_len++;
+
+	async_schedule();
+	return TRUE;
+}
+
+
+/*---------------------------------------------------------------------------*/
+// ctimer callback: sends the msgs that are due, retransmissions keep the seq and back off
+static void send_asyn_msg(void *ptr) {
+	async_item_t *item;
+	const uint8_t *frame;
+	clock_time_t now = clock_time();
+	uint8_t i = 0, in_flight = async_in_flight(), frame_len;
+
+	while (i < async_q_len) {
+		item = &async_q[i];
+		if (((item->num_tx == 0) && (in_flight >= ASYNC_WINDOW)) ||
+			((clock_time_t)(now - item->start) < item->wait)) {
+			i++;
+			continue;
+		}
+		if (item->num_tx > NUM_ASYNC_MSG_RETRANS) {
+			LOG(EV_ASYNC_GIVEUP, item->msg.seq, item->msg.cmd);
+			async_remove(i);
+			in_flight--;
+			continue;
+		}
+
+		if (is_connected()==TRUE) {
+			reply = item->msg;
+			frame = tx_frame;
+			frame_len = 0;
+			if (ASYNC_COMPACT_OK(item->enc)) {
+				frame_len = make_compact_frame(tx_frame, &reply, compact_arg_len(&reply), net_db.app_code, &async_ccm, item->enc);
+			}
+			if (frame_len == 0) {
+				make_packet_for_node(&reply, net_db.app_code, &async_ccm, item->enc);
+				frame = (const uint8_t *)&reply;
+				frame_len = MAX_CMD_LEN;
+			}
+			uip_udp_packet_send(client_conn, frame, frame_len);
+			LOG(EV_ASYNC_TX, frame_len, item->msg.seq, item->msg.cmd);
 		}
 		else {
-			PRINTF("Failed to send ASYNC msg [%d]: Route to BR found but unauthenticated...\n", async_seq);
+			LOG0(EV_ASYNC_NOROUTE);
 		}
+
+		if (item->num_tx++ == 0) {
+			in_flight++;
+		}
+		item->start = now;
+		item->wait = item->rto + async_jitter();
+		item->rto = (item->rto < ASYNC_RTO_MAX/2) ? 2*item->rto : ASYNC_RTO_MAX;
+		i++;
 	}
-	else {
-		PRINTF("Failed to send ASYNC msg: No route to BR found...\n");
+	async_schedule();
+}
+
+
+/*---------------------------------------------------------------------------*/
+// distance between two readings, also across a wrap of a signed value
+static uint8_t out_of_band(uint16_t now, uint16_t last, uint16_t band) {
+	uint16_t d = now - last;
+
+	if (d > 0x7FFF) {
+		d = -d;
+	}
+	return (d >= band);
+}
+
+/*---------------------------------------------------------------------------*/
+static void sensor_ring_put(void) {
+	uint16_t *v = sensor_ring[sensor_head++ & (SENSOR_RING_LEN-1)];
+
+	v[0] = env_db.temp;
+	v[1] = env_db.light;
+	v[2] = env_db.pressure;
+	v[3] = env_db.humidity;
+	if (sensor_n < SENSOR_RING_LEN) {
+		sensor_n++;
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+// statistics of the sensor_n readings of the ring, oldest first
+static void sensor_window(sensor_agg_t *agg) {
+	int32_t v, sum[SENSOR_FIELDS];
+	uint8_t i, f;
+
+	agg->n = sensor_n;
+	for (i=0; i<sensor_n; i++) {
+		for (f=0; f<SENSOR_FIELDS; f++) {
+			v = sensor_ring[(uint8_t)(sensor_head - sensor_n + i) & (SENSOR_RING_LEN-1)][f];
+			if (SENSOR_SIGNED & (1 << f)) {
+				v = (int16_t)v;
+			}
+			if ((i == 0) || (v < agg->min[f])) {
+				agg->min[f] = v;
+			}
+			if ((i == 0) || (v > agg->max[f])) {
+				agg->max[f] = v;
+			}
+			sum[f] = (i == 0) ? v : sum[f] + v;
+			agg->last[f] = v;
+		}
+	}
+	for (f=0; f<SENSOR_FIELDS; f++) {
+		agg->mean[f] = sum[f] / sensor_n;
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+// after each sensor read: the window goes to the BR only when a value left its deadband
+// around the last one reported, or when nothing was sent for TELEMETRY_HEARTBEAT
+static void send_telemetry(void) {
+	sensor_agg_t agg;
+
+	if (telemetry_silence < TELEMETRY_HEARTBEAT) {
+		telemetry_silence += READ_SENSOR_PERIOD;
+	}
+	if ((state!=STATE_NORMAL) || (emergency_status!=TRUE) || (net_db.authenticated!=TRUE)) {
+		PRINTF("Can not send ASYNC msg: state = %d, emergency_status = %d, authenticated = %d \n", state, emergency_status, net_db.authenticated);
+		return;
+	}
+	if ((env_sent_valid == TRUE) && (telemetry_silence < TELEMETRY_HEARTBEAT) &&
+		(out_of_band(env_db.temp, env_sent.temp, DEADBAND_TEMP)==FALSE) &&
+		(out_of_band(env_db.light, env_sent.light, DEADBAND_LIGHT)==FALSE) &&
+		(out_of_band(env_db.pressure, env_sent.pressure, DEADBAND_PRESSURE)==FALSE) &&
+		(out_of_band(env_db.humidity, env_sent.humidity, DEADBAND_HUMIDITY)==FALSE)) {
+		telemetry_skipped++;
+		LOG(EV_TELEMETRY_SKIP, telemetry_silence);
+		return;
+	}
+
+	sensor_window(&agg);
+	emer_reply.err_code = ERR_NORMAL;
+	memset(&emer_reply.arg, 0, MAX_CMD_DATA_LEN);
+	if ((tele_ref_valid == TRUE) && (sensor_delta_pack(emer_reply.arg, &agg, &tele_ref, tele_ref_base) > 0)) {
+		emer_reply.cmd = ASYNC_MSG_SENSOR_DELTA;
+		tele_pending = agg;
+	} else {
+		emer_reply.cmd = ASYNC_MSG_SENSOR_AGG;
+		sensor_agg_pack(emer_reply.arg, &agg);
+		sensor_agg_unpack(&tele_pending, emer_reply.arg);	// as the BR sees it
+	}
+	// retransmitted with the same seq until acked, ahead of the other async msgs
+	if (queue_asyn_msg(encryption_phase, TRUE)==TRUE) {
+		tele_pending_seq = async_seq;
+		tele_pending_valid = TRUE;
+		sensor_n = 0;
+		env_sent = env_db;
+		env_sent_valid = TRUE;
+		telemetry_silence = 0;
+		telemetry_sent++;
+		LOG(EV_TELEMETRY, telemetry_sent, telemetry_skipped);
+		emergency_status = SEND_ASYNC_MSG_CONTINUOUS;		// send once or continuously, if FALSE: send once.
+		blink_led(GREEN);
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+// ACK from the gateway: the msg leaves the queue and frees its window slot
+static void ack_asyn_msg(uint16_t seq) {
+	uint8_t i;
+
+	for (i=0; i<async_q_len; i++) {
+		if ((async_q[i].num_tx > 0) && (async_q[i].msg.seq == seq)) {
+			LOG(EV_ASYNC_ACK, seq, async_q[i].num_tx);
+			/* the BR has this report: the next ones are sent as changes to it */
+			if ((tele_pending_valid == TRUE) && (tele_pending_seq == seq)) {
+				tele_ref = tele_pending;
+				tele_ref_base = seq & 0xFF;
+				tele_ref_valid = TRUE;
+				tele_pending_valid = FALSE;
+			}
+			async_remove(i);
+			async_schedule();
+			return;
+		}
 	}
 }
 
@@ -772,95 +1406,57 @@ static uint32_t rand_delay() {
 
 
 /*---------------------------------------------------------------------------*/
-static void et_timeout_hanler(){
-	uint8_t j = 0;
+// heart beat of network connectivity
+// RED blink: connected; RED solid: disconnected
+static void heartbeat_led(void) {
+	if (is_connected()==TRUE) {leds_toggle(RED);}
+	else {leds_on(RED);}
+}
 
-	timer_cnt_1s++;
+/*---------------------------------------------------------------------------*/
+static void read_sensor_task(void) {
+	PRINTF("\nTimer: %ds expired... reading sensors\n", READ_SENSOR_PERIOD);
+	process_sensor(PRINT_SENSOR);
+	sensor_ring_put();
+	send_telemetry();
+}
 
-	if (timer_cnt_1s<10) {
-		timer_cnt_1s ++;
+/*---------------------------------------------------------------------------*/
+// check join/disjoin every JOIN_CHECK_PERIOD
+static void check_join(void) {
+	if (is_connected()==TRUE) {
+		get_next_hop_addr();
+		net_db.connected = TRUE;
+		net_db.lost_connection_cnt = 0;
+		if ((net_db.authenticated==FALSE)  && (sent_authen_msg==FALSE)){
+			PRINTF("Send authentication request: \n");
+			reset_sequence();
+			emer_reply.cmd = ASYNC_MSG_JOINED;
+			emer_reply.err_code = ERR_NORMAL;
+			memcpy(&emer_reply.arg, &env_db, sizeof(env_db));
 
-		// heart beat of network connectivity
-		// RED blink: connected; RED solid: disconnected
-		if (is_connected()==TRUE) {leds_toggle(RED);}
-		else {leds_on(RED);}
-	}
-	else {
-		timer_cnt_1s = 0; 	//reset 1s cnt
-		timer_cnt++;		//10s, 20s, 30s,...
-		// count in 600s: timer_cnt timeout = 10s
-		if (timer_cnt==60) {timer_cnt =0;}
-
-		/* read sensors every READ_SENSOR_PERIOD = 10s */
-		if ((timer_cnt % (READ_SENSOR_PERIOD / 10))==0) {
-			PRINTF("\nTimer: %ds expired... reading sensors, timer_cnt (10s) = %d \n", READ_SENSOR_PERIOD, timer_cnt);
-    		process_sensor(PRINT_SENSOR);
-
-    		if (timer_cnt > 60) {  // crash or something wrong--> reboot
-    			PRINTF("- Something wrong: timer_cnt = %d,... RESET", timer_cnt);
-    			watchdog_reboot();	
-    		}
-    	}	
-	
-		/* send an async msg every SEND_ASYN_MSG_PERIOD seconds */
-		if ((timer_cnt % (SEND_ASYN_MSG_PERIOD / 10) )==0) {				
-			if ((state==STATE_NORMAL) && (emergency_status==TRUE) && (net_db.authenticated==TRUE)) {	
-				PRINTF("\nTimer: %ds expired: send an async msg, retrans_max = %d \n", SEND_ASYN_MSG_PERIOD, NUM_ASYNC_MSG_RETRANS);
-				emer_reply.cmd = ASYNC_MSG_SENT;
-				emer_reply.err_code = ERR_NORMAL;
-
-				// try to send NUM_ASYNC_MSG_RETRANS times
-				j =NUM_ASYNC_MSG_RETRANS;
-				while ((j--)>0) {
-					PRINTF(" - retrans_num = %d: \n", NUM_ASYNC_MSG_RETRANS-j-1);
-					send_asyn_msg(encryption_phase);
-					async_seq--; 		// send multiple msg with same seq
-				} 
-				async_seq++;	
-				emergency_status = SEND_ASYNC_MSG_CONTINUOUS;		// send once or continuously, if FALSE: send once.
-				blink_led(GREEN);
-			}
-			else {
-				PRINTF("Can not send ASYNC msg: state = %d, emergency_status = %d, authenticated = %d \n", state, emergency_status, net_db.authenticated);					
-			}
+			queue_asyn_msg(encryption_phase, FALSE);
+			leds_off(GREEN);
 		}
 
-		/* 50s events */
-		if ((timer_cnt % 5)==0) {
-			/* check join/disjoin in 50s */
-			if (is_connected()==TRUE) {
-				get_next_hop_addr();
-    			net_db.connected = TRUE;
-	    		net_db.lost_connection_cnt = 0;
-	    		if ((net_db.authenticated==FALSE)  && (sent_authen_msg==FALSE)){
-					PRINTF("Send authentication request: \n");					
-					reset_sequence();
-					emer_reply.cmd = ASYNC_MSG_JOINED;
-					emer_reply.err_code = ERR_NORMAL;
-
-					send_asyn_msg(encryption_phase);
-	    			leds_off(GREEN);
-	    		}
-
-    		} else { // not connected
-	    		PRINTF("Network status: NOT CONNECTED \n");
-		    	net_db.lost_connection_cnt++; 	
-
-		    	// if lost connection in 150s then confirm connected = FALSE, but still authenticated
-	    		if (net_db.lost_connection_cnt==3) {	
-	    			net_db.connected = FALSE;
-	    			net_db.lost_connection_cnt=0;
-					PRINTF("Lost parent DAG in 150s... try to repair root\n");
-					rpl_repair_root(RPL_DEFAULT_INSTANCE);
-
-					// reset authentication 		
-		    		net_db.authenticated= FALSE;
-		    		sent_authen_msg = FALSE;
-	    		}
-    		}
-    	}
-    }
-}	
+	} else { // not connected
+		PRINTF("Network status: NOT CONNECTED \n");
+		net_db.lost_connection_cnt++;
+
+		// if lost connection in 3 checks then confirm connected = FALSE, but still authenticated
+		if (net_db.lost_connection_cnt==3) {
+			net_db.connected = FALSE;
+			net_db.lost_connection_cnt=0;
+			PRINTF("Lost parent DAG in %ds... try to repair root\n", 3*JOIN_CHECK_PERIOD);
+			rpl_repair_root(RPL_DEFAULT_INSTANCE);
+
+			// reset authentication: JOINED goes in clear, as its seq restarts
+			net_db.authenticated= FALSE;
+			sent_authen_msg = FALSE;
+			encryption_phase = FALSE;
+		}
+	}
+}
 
 
 /*---------------------------------------------------------------------------*/
@@ -991,13 +1587,14 @@ void show_configuration() {
 	PRINTF("- Security enable =%d, LLSEC level = %d, Encryption mode = %d \n", SECURITY_EN, NONCORESEC_CONF_SEC_LVL, ENCRYPTION_MODE);
 	PRINTF("- Routing: WITH_NON_STORING = %d\n", WITH_NON_STORING);	
 	PRINTF("- Channel check rate = %d\n", NETSTACK_CONF_RDC_CHANNEL_CHECK_RATE);	
+	PRINTF("- Low power profile = %d, LPM = %d, LED heartbeat = %d ticks\n", SLS_LOW_POWER, LPM_CONF_ENABLE, LED_HEARTBEAT_PERIOD);
 #ifdef CC2538DK_HAS_SHIELD		
 	PRINTF("- Init parameters, timers, sensor_shield = ENABLED, reading_sensor_interval = %d \n", READ_SENSOR_PERIOD);
 #else
 	PRINTF("- Init parameters, timers, sensor_shield = DISABLED, reading_sensor_interval = %d  \n", READ_SENSOR_PERIOD);
 #endif
 	
-	PRINTF("- Async msg sending interval = %d, num_of_retrans_asyn = %d \n", SEND_ASYN_MSG_PERIOD, NUM_ASYNC_MSG_RETRANS);	
+	PRINTF("- Async msg on change, heartbeat = %d, num_of_retrans_asyn = %d \n", TELEMETRY_HEARTBEAT, NUM_ASYNC_MSG_RETRANS);	
 	PRINTF("---------------------------------------------------\n");
 }
 
@@ -1011,9 +1608,16 @@ PROCESS_THREAD(udp_echo_server_process, ev, data) {
 	show_configuration();	
 
 	init_default_parameters();
+	log_init();
+	led_anim_init();
 	
-	/* timer for events */
-	etimer_set(&et, CLOCK_SECOND*1);
+	/* periodic tasks: the CPU is woken up only when one of them is due */
+	sched_init();
+	if (LED_HEARTBEAT_PERIOD > 0) {
+		sched_add(&heartbeat_task, LED_HEARTBEAT_PERIOD, LED_HEARTBEAT_PERIOD, heartbeat_led);
+	}
+	sched_add(&sensor_task, READ_SENSOR_PERIOD*CLOCK_SECOND, READ_SENSOR_PERIOD*CLOCK_SECOND, read_sensor_task);
+	sched_add(&join_task, JOIN_CHECK_PERIOD*CLOCK_SECOND, JOIN_CHECK_PERIOD*CLOCK_SECOND, check_join);
 
 	/*if having sensor shield */
 	init_sensor();
@@ -1025,6 +1629,11 @@ PROCESS_THREAD(udp_echo_server_process, ev, data) {
 	server_conn = udp_new(NULL, UIP_HTONS(0), NULL);
   	if (server_conn == NULL) 	{PROCESS_EXIT();}
   	udp_bind(server_conn, UIP_HTONS(SLS_NORMAL_PORT));
+
+#if SLS_MULTICAST
+	/* group commands: one msg through the mesh instead of one request per node */
+	join_group();
+#endif
 	
   	/* setup client connection for asyn message to server [aaaa::1] */
   	set_connection_address(&server_ipaddr);
@@ -1053,11 +1662,13 @@ PROCESS_THREAD(udp_echo_server_process, ev, data) {
     		get_next_hop_addr();
       		tcpip_handler();
     	} 	
-    	/* ev timeout */
-    	else if (ev==PROCESS_EVENT_TIMER) {
-    		et_timeout_hanler();
-    		etimer_restart(&et);
-   		}
+#ifdef SLS_USING_CC2538DK
+    	/* LED-driver data from UART0 */
+    	else if (ev==PROCESS_EVENT_POLL) {
+			emer_reply.cmd = ASYNC_MSG_LED_DRIVER;		// arg from the LED-driver
+			queue_asyn_msg(encryption_phase, TRUE);
+    	}
+#endif
   	}
 	PROCESS_END();
 }
\ No newline at end of file
@@ -16,59 +16,373 @@
 #include "net/ip/uip-debug.h"
 #include "sls.h"
 #include "util.h"
+#include "log_buf.h"
 
 
 #define CBC 1
 #define ECB 1
 #include "aes_lib.h" 
 
+#if SLS_HW_CRYPTO
+#include "dev/crypto.h"
+#include "dev/aes.h"
+#include "dev/ccm.h"
+#endif
+
 /*---------------------------------------------------------------------------*/
-uint16_t gen_crc16(uint8_t *data_p, unsigned short  length) {
-    unsigned char i;
-    unsigned int data;
-    unsigned int crc = 0xffff;
-    uint8_t len;
-    len = length;
+/* CRC16 of the frame: reflected POLY (0x8408), init 0xFFFF, complemented and byte-swapped.
+   CRC16_TABLE (sls.h) selects the lookup: 0 = nibble, 1 = byte, 2 = slicing-by-8 */
+#if (POLY != 0x8408)
+#error "crc16 tables below are generated for POLY 0x8408"
+#endif
 
-    if (len== 0)
-        return (~crc);
-    do    {
-        for (i=0, data=(unsigned int)0xff & *data_p++; i < 8; i++, data >>= 1) {
-            if ((crc & 0x0001) ^ (data & 0x0001))
-                crc = (crc >> 1) ^ POLY;
-            else  crc >>= 1;
-        }
-    } while (--len);
+#if (CRC16_TABLE==0)
+static const uint16_t crc16_nibble[16] = {
+    0x0000, 0x1081, 0x2102, 0x3183, 0x4204, 0x5285, 0x6306, 0x7387,
+    0x8408, 0x9489, 0xA50A, 0xB58B, 0xC60C, 0xD68D, 0xE70E, 0xF78F
+};
+#else
+static const uint16_t crc16_table[256] = {
+    0x0000, 0x1189, 0x2312, 0x329B, 0x4624, 0x57AD, 0x6536, 0x74BF,
+    0x8C48, 0x9DC1, 0xAF5A, 0xBED3, 0xCA6C, 0xDBE5, 0xE97E, 0xF8F7,
+    0x1081, 0x0108, 0x3393, 0x221A, 0x56A5, 0x472C, 0x75B7, 0x643E,
+    0x9CC9, 0x8D40, 0xBFDB, 0xAE52, 0xDAED, 0xCB64, 0xF9FF, 0xE876,
+    0x2102, 0x308B, 0x0210, 0x1399, 0x6726, 0x76AF, 0x4434, 0x55BD,
+    0xAD4A, 0xBCC3, 0x8E58, 0x9FD1, 0xEB6E, 0xFAE7, 0xC87C, 0xD9F5,
+    0x3183, 0x200A, 0x1291, 0x0318, 0x77A7, 0x662E, 0x54B5, 0x453C,
+    0xBDCB, 0xAC42, 0x9ED9, 0x8F50, 0xFBEF, 0xEA66, 0xD8FD, 0xC974,
+    0x4204, 0x538D, 0x6116, 0x709F, 0x0420, 0x15A9, 0x2732, 0x36BB,
+    0xCE4C, 0xDFC5, 0xED5E, 0xFCD7, 0x8868, 0x99E1, 0xAB7A, 0xBAF3,
+    0x5285, 0x430C, 0x7197, 0x601E, 0x14A1, 0x0528, 0x37B3, 0x263A,
+    0xDECD, 0xCF44, 0xFDDF, 0xEC56, 0x98E9, 0x8960, 0xBBFB, 0xAA72,
+    0x6306, 0x728F, 0x4014, 0x519D, 0x2522, 0x34AB, 0x0630, 0x17B9,
+    0xEF4E, 0xFEC7, 0xCC5C, 0xDDD5, 0xA96A, 0xB8E3, 0x8A78, 0x9BF1,
+    0x7387, 0x620E, 0x5095, 0x411C, 0x35A3, 0x242A, 0x16B1, 0x0738,
+    0xFFCF, 0xEE46, 0xDCDD, 0xCD54, 0xB9EB, 0xA862, 0x9AF9, 0x8B70,
+    0x8408, 0x9581, 0xA71A, 0xB693, 0xC22C, 0xD3A5, 0xE13E, 0xF0B7,
+    0x0840, 0x19C9, 0x2B52, 0x3ADB, 0x4E64, 0x5FED, 0x6D76, 0x7CFF,
+    0x9489, 0x8500, 0xB79B, 0xA612, 0xD2AD, 0xC324, 0xF1BF, 0xE036,
+    0x18C1, 0x0948, 0x3BD3, 0x2A5A, 0x5EE5, 0x4F6C, 0x7DF7, 0x6C7E,
+    0xA50A, 0xB483, 0x8618, 0x9791, 0xE32E, 0xF2A7, 0xC03C, 0xD1B5,
+    0x2942, 0x38CB, 0x0A50, 0x1BD9, 0x6F66, 0x7EEF, 0x4C74, 0x5DFD,
+    0xB58B, 0xA402, 0x9699, 0x8710, 0xF3AF, 0xE226, 0xD0BD, 0xC134,
+    0x39C3, 0x284A, 0x1AD1, 0x0B58, 0x7FE7, 0x6E6E, 0x5CF5, 0x4D7C,
+    0xC60C, 0xD785, 0xE51E, 0xF497, 0x8028, 0x91A1, 0xA33A, 0xB2B3,
+    0x4A44, 0x5BCD, 0x6956, 0x78DF, 0x0C60, 0x1DE9, 0x2F72, 0x3EFB,
+    0xD68D, 0xC704, 0xF59F, 0xE416, 0x90A9, 0x8120, 0xB3BB, 0xA232,
+    0x5AC5, 0x4B4C, 0x79D7, 0x685E, 0x1CE1, 0x0D68, 0x3FF3, 0x2E7A,
+    0xE70E, 0xF687, 0xC41C, 0xD595, 0xA12A, 0xB0A3, 0x8238, 0x93B1,
+    0x6B46, 0x7ACF, 0x4854, 0x59DD, 0x2D62, 0x3CEB, 0x0E70, 0x1FF9,
+    0xF78F, 0xE606, 0xD49D, 0xC514, 0xB1AB, 0xA022, 0x92B9, 0x8330,
+    0x7BC7, 0x6A4E, 0x58D5, 0x495C, 0x3DE3, 0x2C6A, 0x1EF1, 0x0F78
+};
+#endif
+
+#if (CRC16_TABLE==2)
+/* crc16_table advanced over 1..7 more zero bytes */
+static const uint16_t crc16_slice[7][256] = {
+  { /* byte 6 of an 8-byte step */
+    0x0000, 0x19D8, 0x33B0, 0x2A68, 0x6760, 0x7EB8, 0x54D0, 0x4D08,
+    0xCEC0, 0xD718, 0xFD70, 0xE4A8, 0xA9A0, 0xB078, 0x9A10, 0x83C8,
+    0x9591, 0x8C49, 0xA621, 0xBFF9, 0xF2F1, 0xEB29, 0xC141, 0xD899,
+    0x5B51, 0x4289, 0x68E1, 0x7139, 0x3C31, 0x25E9, 0x0F81, 0x1659,
+    0x2333, 0x3AEB, 0x1083, 0x095B, 0x4453, 0x5D8B, 0x77E3, 0x6E3B,
+    0xEDF3, 0xF42B, 0xDE43, 0xC79B, 0x8A93, 0x934B, 0xB923, 0xA0FB,
+    0xB6A2, 0xAF7A, 0x8512, 0x9CCA, 0xD1C2, 0xC81A, 0xE272, 0xFBAA,
+    0x7862, 0x61BA, 0x4BD2, 0x520A, 0x1F02, 0x06DA, 0x2CB2, 0x356A,
+    0x4666, 0x5FBE, 0x75D6, 0x6C0E, 0x2106, 0x38DE, 0x12B6, 0x0B6E,
+    0x88A6, 0x917E, 0xBB16, 0xA2CE, 0xEFC6, 0xF61E, 0xDC76, 0xC5AE,
+    0xD3F7, 0xCA2F, 0xE047, 0xF99F, 0xB497, 0xAD4F, 0x8727, 0x9EFF,
+    0x1D37, 0x04EF, 0x2E87, 0x375F, 0x7A57, 0x638F, 0x49E7, 0x503F,
+    0x6555, 0x7C8D, 0x56E5, 0x4F3D, 0x0235, 0x1BED, 0x3185, 0x285D,
+    0xAB95, 0xB24D, 0x9825, 0x81FD, 0xCCF5, 0xD52D, 0xFF45, 0xE69D,
+    0xF0C4, 0xE91C, 0xC374, 0xDAAC, 0x97A4, 0x8E7C, 0xA414, 0xBDCC,
+    0x3E04, 0x27DC, 0x0DB4, 0x146C, 0x5964, 0x40BC, 0x6AD4, 0x730C,
+    0x8CCC, 0x9514, 0xBF7C, 0xA6A4, 0xEBAC, 0xF274, 0xD81C, 0xC1C4,
+    0x420C, 0x5BD4, 0x71BC, 0x6864, 0x256C, 0x3CB4, 0x16DC, 0x0F04,
+    0x195D, 0x0085, 0x2AED, 0x3335, 0x7E3D, 0x67E5, 0x4D8D, 0x5455,
+    0xD79D, 0xCE45, 0xE42D, 0xFDF5, 0xB0FD, 0xA925, 0x834D, 0x9A95,
+    0xAFFF, 0xB627, 0x9C4F, 0x8597, 0xC89F, 0xD147, 0xFB2F, 0xE2F7,
+    0x613F, 0x78E7, 0x528F, 0x4B57, 0x065F, 0x1F87, 0x35EF, 0x2C37,
+    0x3A6E, 0x23B6, 0x09DE, 0x1006, 0x5D0E, 0x44D6, 0x6EBE, 0x7766,
+    0xF4AE, 0xED76, 0xC71E, 0xDEC6, 0x93CE, 0x8A16, 0xA07E, 0xB9A6,
+    0xCAAA, 0xD372, 0xF91A, 0xE0C2, 0xADCA, 0xB412, 0x9E7A, 0x87A2,
+    0x046A, 0x1DB2, 0x37DA, 0x2E02, 0x630A, 0x7AD2, 0x50BA, 0x4962,
+    0x5F3B, 0x46E3, 0x6C8B, 0x7553, 0x385B, 0x2183, 0x0BEB, 0x1233,
+    0x91FB, 0x8823, 0xA24B, 0xBB93, 0xF69B, 0xEF43, 0xC52B, 0xDCF3,
+    0xE999, 0xF041, 0xDA29, 0xC3F1, 0x8EF9, 0x9721, 0xBD49, 0xA491,
+    0x2759, 0x3E81, 0x14E9, 0x0D31, 0x4039, 0x59E1, 0x7389, 0x6A51,
+    0x7C08, 0x65D0, 0x4FB8, 0x5660, 0x1B68, 0x02B0, 0x28D8, 0x3100,
+    0xB2C8, 0xAB10, 0x8178, 0x98A0, 0xD5A8, 0xCC70, 0xE618, 0xFFC0
+  },
+  { /* byte 5 of an 8-byte step */
+    0x0000, 0x5ADC, 0xB5B8, 0xEF64, 0x6361, 0x39BD, 0xD6D9, 0x8C05,
+    0xC6C2, 0x9C1E, 0x737A, 0x29A6, 0xA5A3, 0xFF7F, 0x101B, 0x4AC7,
+    0x8595, 0xDF49, 0x302D, 0x6AF1, 0xE6F4, 0xBC28, 0x534C, 0x0990,
+    0x4357, 0x198B, 0xF6EF, 0xAC33, 0x2036, 0x7AEA, 0x958E, 0xCF52,
+    0x033B, 0x59E7, 0xB683, 0xEC5F, 0x605A, 0x3A86, 0xD5E2, 0x8F3E,
+    0xC5F9, 0x9F25, 0x7041, 0x2A9D, 0xA698, 0xFC44, 0x1320, 0x49FC,
+    0x86AE, 0xDC72, 0x3316, 0x69CA, 0xE5CF, 0xBF13, 0x5077, 0x0AAB,
+    0x406C, 0x1AB0, 0xF5D4, 0xAF08, 0x230D, 0x79D1, 0x96B5, 0xCC69,
+    0x0676, 0x5CAA, 0xB3CE, 0xE912, 0x6517, 0x3FCB, 0xD0AF, 0x8A73,
+    0xC0B4, 0x9A68, 0x750C, 0x2FD0, 0xA3D5, 0xF909, 0x166D, 0x4CB1,
+    0x83E3, 0xD93F, 0x365B, 0x6C87, 0xE082, 0xBA5E, 0x553A, 0x0FE6,
+    0x4521, 0x1FFD, 0xF099, 0xAA45, 0x2640, 0x7C9C, 0x93F8, 0xC924,
+    0x054D, 0x5F91, 0xB0F5, 0xEA29, 0x662C, 0x3CF0, 0xD394, 0x8948,
+    0xC38F, 0x9953, 0x7637, 0x2CEB, 0xA0EE, 0xFA32, 0x1556, 0x4F8A,
+    0x80D8, 0xDA04, 0x3560, 0x6FBC, 0xE3B9, 0xB965, 0x5601, 0x0CDD,
+    0x461A, 0x1CC6, 0xF3A2, 0xA97E, 0x257B, 0x7FA7, 0x90C3, 0xCA1F,
+    0x0CEC, 0x5630, 0xB954, 0xE388, 0x6F8D, 0x3551, 0xDA35, 0x80E9,
+    0xCA2E, 0x90F2, 0x7F96, 0x254A, 0xA94F, 0xF393, 0x1CF7, 0x462B,
+    0x8979, 0xD3A5, 0x3CC1, 0x661D, 0xEA18, 0xB0C4, 0x5FA0, 0x057C,
+    0x4FBB, 0x1567, 0xFA03, 0xA0DF, 0x2CDA, 0x7606, 0x9962, 0xC3BE,
+    0x0FD7, 0x550B, 0xBA6F, 0xE0B3, 0x6CB6, 0x366A, 0xD90E, 0x83D2,
+    0xC915, 0x93C9, 0x7CAD, 0x2671, 0xAA74, 0xF0A8, 0x1FCC, 0x4510,
+    0x8A42, 0xD09E, 0x3FFA, 0x6526, 0xE923, 0xB3FF, 0x5C9B, 0x0647,
+    0x4C80, 0x165C, 0xF938, 0xA3E4, 0x2FE1, 0x753D, 0x9A59, 0xC085,
+    0x0A9A, 0x5046, 0xBF22, 0xE5FE, 0x69FB, 0x3327, 0xDC43, 0x869F,
+    0xCC58, 0x9684, 0x79E0, 0x233C, 0xAF39, 0xF5E5, 0x1A81, 0x405D,
+    0x8F0F, 0xD5D3, 0x3AB7, 0x606B, 0xEC6E, 0xB6B2, 0x59D6, 0x030A,
+    0x49CD, 0x1311, 0xFC75, 0xA6A9, 0x2AAC, 0x7070, 0x9F14, 0xC5C8,
+    0x09A1, 0x537D, 0xBC19, 0xE6C5, 0x6AC0, 0x301C, 0xDF78, 0x85A4,
+    0xCF63, 0x95BF, 0x7ADB, 0x2007, 0xAC02, 0xF6DE, 0x19BA, 0x4366,
+    0x8C34, 0xD6E8, 0x398C, 0x6350, 0xEF55, 0xB589, 0x5AED, 0x0031,
+    0x4AF6, 0x102A, 0xFF4E, 0xA592, 0x2997, 0x734B, 0x9C2F, 0xC6F3
+  },
+  { /* byte 4 of an 8-byte step */
+    0x0000, 0x1CBB, 0x3976, 0x25CD, 0x72EC, 0x6E57, 0x4B9A, 0x5721,
+    0xE5D8, 0xF963, 0xDCAE, 0xC015, 0x9734, 0x8B8F, 0xAE42, 0xB2F9,
+    0xC3A1, 0xDF1A, 0xFAD7, 0xE66C, 0xB14D, 0xADF6, 0x883B, 0x9480,
+    0x2679, 0x3AC2, 0x1F0F, 0x03B4, 0x5495, 0x482E, 0x6DE3, 0x7158,
+    0x8F53, 0x93E8, 0xB625, 0xAA9E, 0xFDBF, 0xE104, 0xC4C9, 0xD872,
+    0x6A8B, 0x7630, 0x53FD, 0x4F46, 0x1867, 0x04DC, 0x2111, 0x3DAA,
+    0x4CF2, 0x5049, 0x7584, 0x693F, 0x3E1E, 0x22A5, 0x0768, 0x1BD3,
+    0xA92A, 0xB591, 0x905C, 0x8CE7, 0xDBC6, 0xC77D, 0xE2B0, 0xFE0B,
+    0x16B7, 0x0A0C, 0x2FC1, 0x337A, 0x645B, 0x78E0, 0x5D2D, 0x4196,
+    0xF36F, 0xEFD4, 0xCA19, 0xD6A2, 0x8183, 0x9D38, 0xB8F5, 0xA44E,
+    0xD516, 0xC9AD, 0xEC60, 0xF0DB, 0xA7FA, 0xBB41, 0x9E8C, 0x8237,
+    0x30CE, 0x2C75, 0x09B8, 0x1503, 0x4222, 0x5E99, 0x7B54, 0x67EF,
+    0x99E4, 0x855F, 0xA092, 0xBC29, 0xEB08, 0xF7B3, 0xD27E, 0xCEC5,
+    0x7C3C, 0x6087, 0x454A, 0x59F1, 0x0ED0, 0x126B, 0x37A6, 0x2B1D,
+    0x5A45, 0x46FE, 0x6333, 0x7F88, 0x28A9, 0x3412, 0x11DF, 0x0D64,
+    0xBF9D, 0xA326, 0x86EB, 0x9A50, 0xCD71, 0xD1CA, 0xF407, 0xE8BC,
+    0x2D6E, 0x31D5, 0x1418, 0x08A3, 0x5F82, 0x4339, 0x66F4, 0x7A4F,
+    0xC8B6, 0xD40D, 0xF1C0, 0xED7B, 0xBA5A, 0xA6E1, 0x832C, 0x9F97,
+    0xEECF, 0xF274, 0xD7B9, 0xCB02, 0x9C23, 0x8098, 0xA555, 0xB9EE,
+    0x0B17, 0x17AC, 0x3261, 0x2EDA, 0x79FB, 0x6540, 0x408D, 0x5C36,
+    0xA23D, 0xBE86, 0x9B4B, 0x87F0, 0xD0D1, 0xCC6A, 0xE9A7, 0xF51C,
+    0x47E5, 0x5B5E, 0x7E93, 0x6228, 0x3509, 0x29B2, 0x0C7F, 0x10C4,
+    0x619C, 0x7D27, 0x58EA, 0x4451, 0x1370, 0x0FCB, 0x2A06, 0x36BD,
+    0x8444, 0x98FF, 0xBD32, 0xA189, 0xF6A8, 0xEA13, 0xCFDE, 0xD365,
+    0x3BD9, 0x2762, 0x02AF, 0x1E14, 0x4935, 0x558E, 0x7043, 0x6CF8,
+    0xDE01, 0xC2BA, 0xE777, 0xFBCC, 0xACED, 0xB056, 0x959B, 0x8920,
+    0xF878, 0xE4C3, 0xC10E, 0xDDB5, 0x8A94, 0x962F, 0xB3E2, 0xAF59,
+    0x1DA0, 0x011B, 0x24D6, 0x386D, 0x6F4C, 0x73F7, 0x563A, 0x4A81,
+    0xB48A, 0xA831, 0x8DFC, 0x9147, 0xC666, 0xDADD, 0xFF10, 0xE3AB,
+    0x5152, 0x4DE9, 0x6824, 0x749F, 0x23BE, 0x3F05, 0x1AC8, 0x0673,
+    0x772B, 0x6B90, 0x4E5D, 0x52E6, 0x05C7, 0x197C, 0x3CB1, 0x200A,
+    0x92F3, 0x8E48, 0xAB85, 0xB73E, 0xE01F, 0xFCA4, 0xD969, 0xC5D2
+  },
+  { /* byte 3 of an 8-byte step */
+    0x0000, 0x0B44, 0x1688, 0x1DCC, 0x2D10, 0x2654, 0x3B98, 0x30DC,
+    0x5A20, 0x5164, 0x4CA8, 0x47EC, 0x7730, 0x7C74, 0x61B8, 0x6AFC,
+    0xB440, 0xBF04, 0xA2C8, 0xA98C, 0x9950, 0x9214, 0x8FD8, 0x849C,
+    0xEE60, 0xE524, 0xF8E8, 0xF3AC, 0xC370, 0xC834, 0xD5F8, 0xDEBC,
+    0x6091, 0x6BD5, 0x7619, 0x7D5D, 0x4D81, 0x46C5, 0x5B09, 0x504D,
+    0x3AB1, 0x31F5, 0x2C39, 0x277D, 0x17A1, 0x1CE5, 0x0129, 0x0A6D,
+    0xD4D1, 0xDF95, 0xC259, 0xC91D, 0xF9C1, 0xF285, 0xEF49, 0xE40D,
+    0x8EF1, 0x85B5, 0x9879, 0x933D, 0xA3E1, 0xA8A5, 0xB569, 0xBE2D,
+    0xC122, 0xCA66, 0xD7AA, 0xDCEE, 0xEC32, 0xE776, 0xFABA, 0xF1FE,
+    0x9B02, 0x9046, 0x8D8A, 0x86CE, 0xB612, 0xBD56, 0xA09A, 0xABDE,
+    0x7562, 0x7E26, 0x63EA, 0x68AE, 0x5872, 0x5336, 0x4EFA, 0x45BE,
+    0x2F42, 0x2406, 0x39CA, 0x328E, 0x0252, 0x0916, 0x14DA, 0x1F9E,
+    0xA1B3, 0xAAF7, 0xB73B, 0xBC7F, 0x8CA3, 0x87E7, 0x9A2B, 0x916F,
+    0xFB93, 0xF0D7, 0xED1B, 0xE65F, 0xD683, 0xDDC7, 0xC00B, 0xCB4F,
+    0x15F3, 0x1EB7, 0x037B, 0x083F, 0x38E3, 0x33A7, 0x2E6B, 0x252F,
+    0x4FD3, 0x4497, 0x595B, 0x521F, 0x62C3, 0x6987, 0x744B, 0x7F0F,
+    0x8A55, 0x8111, 0x9CDD, 0x9799, 0xA745, 0xAC01, 0xB1CD, 0xBA89,
+    0xD075, 0xDB31, 0xC6FD, 0xCDB9, 0xFD65, 0xF621, 0xEBED, 0xE0A9,
+    0x3E15, 0x3551, 0x289D, 0x23D9, 0x1305, 0x1841, 0x058D, 0x0EC9,
+    0x6435, 0x6F71, 0x72BD, 0x79F9, 0x4925, 0x4261, 0x5FAD, 0x54E9,
+    0xEAC4, 0xE180, 0xFC4C, 0xF708, 0xC7D4, 0xCC90, 0xD15C, 0xDA18,
+    0xB0E4, 0xBBA0, 0xA66C, 0xAD28, 0x9DF4, 0x96B0, 0x8B7C, 0x8038,
+    0x5E84, 0x55C0, 0x480C, 0x4348, 0x7394, 0x78D0, 0x651C, 0x6E58,
+    0x04A4, 0x0FE0, 0x122C, 0x1968, 0x29B4, 0x22F0, 0x3F3C, 0x3478,
+    0x4B77, 0x4033, 0x5DFF, 0x56BB, 0x6667, 0x6D23, 0x70EF, 0x7BAB,
+    0x1157, 0x1A13, 0x07DF, 0x0C9B, 0x3C47, 0x3703, 0x2ACF, 0x218B,
+    0xFF37, 0xF473, 0xE9BF, 0xE2FB, 0xD227, 0xD963, 0xC4AF, 0xCFEB,
+    0xA517, 0xAE53, 0xB39F, 0xB8DB, 0x8807, 0x8343, 0x9E8F, 0x95CB,
+    0x2BE6, 0x20A2, 0x3D6E, 0x362A, 0x06F6, 0x0DB2, 0x107E, 0x1B3A,
+    0x71C6, 0x7A82, 0x674E, 0x6C0A, 0x5CD6, 0x5792, 0x4A5E, 0x411A,
+    0x9FA6, 0x94E2, 0x892E, 0x826A, 0xB2B6, 0xB9F2, 0xA43E, 0xAF7A,
+    0xC586, 0xCEC2, 0xD30E, 0xD84A, 0xE896, 0xE3D2, 0xFE1E, 0xF55A
+  },
+  { /* byte 2 of an 8-byte step */
+    0x0000, 0x042B, 0x0856, 0x0C7D, 0x10AC, 0x1487, 0x18FA, 0x1CD1,
+    0x2158, 0x2573, 0x290E, 0x2D25, 0x31F4, 0x35DF, 0x39A2, 0x3D89,
+    0x42B0, 0x469B, 0x4AE6, 0x4ECD, 0x521C, 0x5637, 0x5A4A, 0x5E61,
+    0x63E8, 0x67C3, 0x6BBE, 0x6F95, 0x7344, 0x776F, 0x7B12, 0x7F39,
+    0x8560, 0x814B, 0x8D36, 0x891D, 0x95CC, 0x91E7, 0x9D9A, 0x99B1,
+    0xA438, 0xA013, 0xAC6E, 0xA845, 0xB494, 0xB0BF, 0xBCC2, 0xB8E9,
+    0xC7D0, 0xC3FB, 0xCF86, 0xCBAD, 0xD77C, 0xD357, 0xDF2A, 0xDB01,
+    0xE688, 0xE2A3, 0xEEDE, 0xEAF5, 0xF624, 0xF20F, 0xFE72, 0xFA59,
+    0x02D1, 0x06FA, 0x0A87, 0x0EAC, 0x127D, 0x1656, 0x1A2B, 0x1E00,
+    0x2389, 0x27A2, 0x2BDF, 0x2FF4, 0x3325, 0x370E, 0x3B73, 0x3F58,
+    0x4061, 0x444A, 0x4837, 0x4C1C, 0x50CD, 0x54E6, 0x589B, 0x5CB0,
+    0x6139, 0x6512, 0x696F, 0x6D44, 0x7195, 0x75BE, 0x79C3, 0x7DE8,
+    0x87B1, 0x839A, 0x8FE7, 0x8BCC, 0x971D, 0x9336, 0x9F4B, 0x9B60,
+    0xA6E9, 0xA2C2, 0xAEBF, 0xAA94, 0xB645, 0xB26E, 0xBE13, 0xBA38,
+    0xC501, 0xC12A, 0xCD57, 0xC97C, 0xD5AD, 0xD186, 0xDDFB, 0xD9D0,
+    0xE459, 0xE072, 0xEC0F, 0xE824, 0xF4F5, 0xF0DE, 0xFCA3, 0xF888,
+    0x05A2, 0x0189, 0x0DF4, 0x09DF, 0x150E, 0x1125, 0x1D58, 0x1973,
+    0x24FA, 0x20D1, 0x2CAC, 0x2887, 0x3456, 0x307D, 0x3C00, 0x382B,
+    0x4712, 0x4339, 0x4F44, 0x4B6F, 0x57BE, 0x5395, 0x5FE8, 0x5BC3,
+    0x664A, 0x6261, 0x6E1C, 0x6A37, 0x76E6, 0x72CD, 0x7EB0, 0x7A9B,
+    0x80C2, 0x84E9, 0x8894, 0x8CBF, 0x906E, 0x9445, 0x9838, 0x9C13,
+    0xA19A, 0xA5B1, 0xA9CC, 0xADE7, 0xB136, 0xB51D, 0xB960, 0xBD4B,
+    0xC272, 0xC659, 0xCA24, 0xCE0F, 0xD2DE, 0xD6F5, 0xDA88, 0xDEA3,
+    0xE32A, 0xE701, 0xEB7C, 0xEF57, 0xF386, 0xF7AD, 0xFBD0, 0xFFFB,
+    0x0773, 0x0358, 0x0F25, 0x0B0E, 0x17DF, 0x13F4, 0x1F89, 0x1BA2,
+    0x262B, 0x2200, 0x2E7D, 0x2A56, 0x3687, 0x32AC, 0x3ED1, 0x3AFA,
+    0x45C3, 0x41E8, 0x4D95, 0x49BE, 0x556F, 0x5144, 0x5D39, 0x5912,
+    0x649B, 0x60B0, 0x6CCD, 0x68E6, 0x7437, 0x701C, 0x7C61, 0x784A,
+    0x8213, 0x8638, 0x8A45, 0x8E6E, 0x92BF, 0x9694, 0x9AE9, 0x9EC2,
+    0xA34B, 0xA760, 0xAB1D, 0xAF36, 0xB3E7, 0xB7CC, 0xBBB1, 0xBF9A,
+    0xC0A3, 0xC488, 0xC8F5, 0xCCDE, 0xD00F, 0xD424, 0xD859, 0xDC72,
+    0xE1FB, 0xE5D0, 0xE9AD, 0xED86, 0xF157, 0xF57C, 0xF901, 0xFD2A
+  },
+  { /* byte 1 of an 8-byte step */
+    0x0000, 0x9FD5, 0x37BB, 0xA86E, 0x6F76, 0xF0A3, 0x58CD, 0xC718,
+    0xDEEC, 0x4139, 0xE957, 0x7682, 0xB19A, 0x2E4F, 0x8621, 0x19F4,
+    0xB5C9, 0x2A1C, 0x8272, 0x1DA7, 0xDABF, 0x456A, 0xED04, 0x72D1,
+    0x6B25, 0xF4F0, 0x5C9E, 0xC34B, 0x0453, 0x9B86, 0x33E8, 0xAC3D,
+    0x6383, 0xFC56, 0x5438, 0xCBED, 0x0CF5, 0x9320, 0x3B4E, 0xA49B,
+    0xBD6F, 0x22BA, 0x8AD4, 0x1501, 0xD219, 0x4DCC, 0xE5A2, 0x7A77,
+    0xD64A, 0x499F, 0xE1F1, 0x7E24, 0xB93C, 0x26E9, 0x8E87, 0x1152,
+    0x08A6, 0x9773, 0x3F1D, 0xA0C8, 0x67D0, 0xF805, 0x506B, 0xCFBE,
+    0xC706, 0x58D3, 0xF0BD, 0x6F68, 0xA870, 0x37A5, 0x9FCB, 0x001E,
+    0x19EA, 0x863F, 0x2E51, 0xB184, 0x769C, 0xE949, 0x4127, 0xDEF2,
+    0x72CF, 0xED1A, 0x4574, 0xDAA1, 0x1DB9, 0x826C, 0x2A02, 0xB5D7,
+    0xAC23, 0x33F6, 0x9B98, 0x044D, 0xC355, 0x5C80, 0xF4EE, 0x6B3B,
+    0xA485, 0x3B50, 0x933E, 0x0CEB, 0xCBF3, 0x5426, 0xFC48, 0x639D,
+    0x7A69, 0xE5BC, 0x4DD2, 0xD207, 0x151F, 0x8ACA, 0x22A4, 0xBD71,
+    0x114C, 0x8E99, 0x26F7, 0xB922, 0x7E3A, 0xE1EF, 0x4981, 0xD654,
+    0xCFA0, 0x5075, 0xF81B, 0x67CE, 0xA0D6, 0x3F03, 0x976D, 0x08B8,
+    0x861D, 0x19C8, 0xB1A6, 0x2E73, 0xE96B, 0x76BE, 0xDED0, 0x4105,
+    0x58F1, 0xC724, 0x6F4A, 0xF09F, 0x3787, 0xA852, 0x003C, 0x9FE9,
+    0x33D4, 0xAC01, 0x046F, 0x9BBA, 0x5CA2, 0xC377, 0x6B19, 0xF4CC,
+    0xED38, 0x72ED, 0xDA83, 0x4556, 0x824E, 0x1D9B, 0xB5F5, 0x2A20,
+    0xE59E, 0x7A4B, 0xD225, 0x4DF0, 0x8AE8, 0x153D, 0xBD53, 0x2286,
+    0x3B72, 0xA4A7, 0x0CC9, 0x931C, 0x5404, 0xCBD1, 0x63BF, 0xFC6A,
+    0x5057, 0xCF82, 0x67EC, 0xF839, 0x3F21, 0xA0F4, 0x089A, 0x974F,
+    0x8EBB, 0x116E, 0xB900, 0x26D5, 0xE1CD, 0x7E18, 0xD676, 0x49A3,
+    0x411B, 0xDECE, 0x76A0, 0xE975, 0x2E6D, 0xB1B8, 0x19D6, 0x8603,
+    0x9FF7, 0x0022, 0xA84C, 0x3799, 0xF081, 0x6F54, 0xC73A, 0x58EF,
+    0xF4D2, 0x6B07, 0xC369, 0x5CBC, 0x9BA4, 0x0471, 0xAC1F, 0x33CA,
+    0x2A3E, 0xB5EB, 0x1D85, 0x8250, 0x4548, 0xDA9D, 0x72F3, 0xED26,
+    0x2298, 0xBD4D, 0x1523, 0x8AF6, 0x4DEE, 0xD23B, 0x7A55, 0xE580,
+    0xFC74, 0x63A1, 0xCBCF, 0x541A, 0x9302, 0x0CD7, 0xA4B9, 0x3B6C,
+    0x9751, 0x0884, 0xA0EA, 0x3F3F, 0xF827, 0x67F2, 0xCF9C, 0x5049,
+    0x49BD, 0xD668, 0x7E06, 0xE1D3, 0x26CB, 0xB91E, 0x1170, 0x8EA5
+  },
+  { /* byte 0 of an 8-byte step */
+    0x0000, 0x81BF, 0x0B6F, 0x8AD0, 0x16DE, 0x9761, 0x1DB1, 0x9C0E,
+    0x2DBC, 0xAC03, 0x26D3, 0xA76C, 0x3B62, 0xBADD, 0x300D, 0xB1B2,
+    0x5B78, 0xDAC7, 0x5017, 0xD1A8, 0x4DA6, 0xCC19, 0x46C9, 0xC776,
+    0x76C4, 0xF77B, 0x7DAB, 0xFC14, 0x601A, 0xE1A5, 0x6B75, 0xEACA,
+    0xB6F0, 0x374F, 0xBD9F, 0x3C20, 0xA02E, 0x2191, 0xAB41, 0x2AFE,
+    0x9B4C, 0x1AF3, 0x9023, 0x119C, 0x8D92, 0x0C2D, 0x86FD, 0x0742,
+    0xED88, 0x6C37, 0xE6E7, 0x6758, 0xFB56, 0x7AE9, 0xF039, 0x7186,
+    0xC034, 0x418B, 0xCB5B, 0x4AE4, 0xD6EA, 0x5755, 0xDD85, 0x5C3A,
+    0x65F1, 0xE44E, 0x6E9E, 0xEF21, 0x732F, 0xF290, 0x7840, 0xF9FF,
+    0x484D, 0xC9F2, 0x4322, 0xC29D, 0x5E93, 0xDF2C, 0x55FC, 0xD443,
+    0x3E89, 0xBF36, 0x35E6, 0xB459, 0x2857, 0xA9E8, 0x2338, 0xA287,
+    0x1335, 0x928A, 0x185A, 0x99E5, 0x05EB, 0x8454, 0x0E84, 0x8F3B,
+    0xD301, 0x52BE, 0xD86E, 0x59D1, 0xC5DF, 0x4460, 0xCEB0, 0x4F0F,
+    0xFEBD, 0x7F02, 0xF5D2, 0x746D, 0xE863, 0x69DC, 0xE30C, 0x62B3,
+    0x8879, 0x09C6, 0x8316, 0x02A9, 0x9EA7, 0x1F18, 0x95C8, 0x1477,
+    0xA5C5, 0x247A, 0xAEAA, 0x2F15, 0xB31B, 0x32A4, 0xB874, 0x39CB,
+    0xCBE2, 0x4A5D, 0xC08D, 0x4132, 0xDD3C, 0x5C83, 0xD653, 0x57EC,
+    0xE65E, 0x67E1, 0xED31, 0x6C8E, 0xF080, 0x713F, 0xFBEF, 0x7A50,
+    0x909A, 0x1125, 0x9BF5, 0x1A4A, 0x8644, 0x07FB, 0x8D2B, 0x0C94,
+    0xBD26, 0x3C99, 0xB649, 0x37F6, 0xABF8, 0x2A47, 0xA097, 0x2128,
+    0x7D12, 0xFCAD, 0x767D, 0xF7C2, 0x6BCC, 0xEA73, 0x60A3, 0xE11C,
+    0x50AE, 0xD111, 0x5BC1, 0xDA7E, 0x4670, 0xC7CF, 0x4D1F, 0xCCA0,
+    0x266A, 0xA7D5, 0x2D05, 0xACBA, 0x30B4, 0xB10B, 0x3BDB, 0xBA64,
+    0x0BD6, 0x8A69, 0x00B9, 0x8106, 0x1D08, 0x9CB7, 0x1667, 0x97D8,
+    0xAE13, 0x2FAC, 0xA57C, 0x24C3, 0xB8CD, 0x3972, 0xB3A2, 0x321D,
+    0x83AF, 0x0210, 0x88C0, 0x097F, 0x9571, 0x14CE, 0x9E1E, 0x1FA1,
+    0xF56B, 0x74D4, 0xFE04, 0x7FBB, 0xE3B5, 0x620A, 0xE8DA, 0x6965,
+    0xD8D7, 0x5968, 0xD3B8, 0x5207, 0xCE09, 0x4FB6, 0xC566, 0x44D9,
+    0x18E3, 0x995C, 0x138C, 0x9233, 0x0E3D, 0x8F82, 0x0552, 0x84ED,
+    0x355F, 0xB4E0, 0x3E30, 0xBF8F, 0x2381, 0xA23E, 0x28EE, 0xA951,
+    0x439B, 0xC224, 0x48F4, 0xC94B, 0x5545, 0xD4FA, 0x5E2A, 0xDF95,
+    0x6E27, 0xEF98, 0x6548, 0xE4F7, 0x78F9, 0xF946, 0x7396, 0xF229
+  }
+};
+#endif
+
+/*---------------------------------------------------------------------------*/
+uint16_t gen_crc16_init(void) {
+    return 0xffff;
+}
+
+/*---------------------------------------------------------------------------*/
+// hashes data_p in place, can be called on consecutive pieces of a frame
+uint16_t gen_crc16_update(uint16_t crc, const uint8_t *data_p, uint16_t length) {
+#if (CRC16_TABLE==2)
+    while (length >= 8) {
+        crc ^= data_p[0] | ((uint16_t)data_p[1] << 8);
+        crc = crc16_slice[6][crc & 0xff] ^ crc16_slice[5][crc >> 8] ^
+              crc16_slice[4][data_p[2]]  ^ crc16_slice[3][data_p[3]] ^
+              crc16_slice[2][data_p[4]]  ^ crc16_slice[1][data_p[5]] ^
+              crc16_slice[0][data_p[6]]  ^ crc16_table[data_p[7]];
+        data_p += 8;
+        length -= 8;
+    }
+#endif
+    while (length--) {
+#if (CRC16_TABLE==0)
+        crc = (crc >> 4) ^ crc16_nibble[(crc ^ *data_p) & 0x0f];
+        crc = (crc >> 4) ^ crc16_nibble[(crc ^ (*data_p >> 4)) & 0x0f];
+#else
+        crc = (crc >> 8) ^ crc16_table[(crc ^ *data_p) & 0xff];
+#endif
+        data_p++;
+    }
+    return crc;
+}
 
+/*---------------------------------------------------------------------------*/
+uint16_t gen_crc16_final(uint16_t crc) {
     crc = ~crc;
-    data = crc;
-    crc = (crc << 8) | (data >> 8 & 0xff);
-    return (crc);
+    return (crc << 8) | (crc >> 8);
+}
+
+/*---------------------------------------------------------------------------*/
+uint16_t gen_crc16(uint8_t *data_p, unsigned short  length) {
+    return gen_crc16_final(gen_crc16_update(gen_crc16_init(), data_p, length));
 }
 
 /*---------------------------------------------------------------------------*/
 void gen_crc_for_cmd(cmd_struct_t *cmd) {
     uint16_t crc16_check;
-    uint8_t byte_arr[MAX_CMD_LEN-2];
-    memcpy(&byte_arr, cmd, MAX_CMD_LEN-2);
-    crc16_check = gen_crc16(byte_arr, MAX_CMD_LEN-2);
+    crc16_check = gen_crc16((uint8_t *)cmd, MAX_CMD_LEN-2);
     cmd->crc = (uint16_t)crc16_check;
-    PRINTF(" - Generate CRC16 [0x%04X]... done \n", crc16_check);
+    LOG(EV_CRC_GEN, crc16_check);
 }
 
 /*---------------------------------------------------------------------------*/
 uint8_t check_crc_for_cmd(cmd_struct_t *cmd) {
     uint16_t crc16_check;
-    uint8_t byte_arr[MAX_CMD_LEN-2];
-    memcpy(&byte_arr, cmd, MAX_CMD_LEN-2);
-    crc16_check = gen_crc16(byte_arr, MAX_CMD_LEN-2);
+    crc16_check = gen_crc16((uint8_t *)cmd, MAX_CMD_LEN-2);
     //PRINTF("CRC-cal = 0x%04X; CRC-val =  0x%04X \n",crc16_check,cmd->crc);
     if (crc16_check == cmd->crc) {
-        PRINTF("CRC16...matched\n");
+        LOG0(EV_CRC_OK);
         return TRUE;
     }
     else{
-        PRINTF("CRC16 ...failed: CRC-cal = 0x%04X; CRC-val =  0x%04X  \n", crc16_check, cmd->crc);
+        LOG(EV_CRC_FAIL, crc16_check, cmd->crc);
         return FALSE;        
     }
 }
@@ -92,33 +406,182 @@ void phex_64(uint8_t* data_64) { // in chuoi hex 64 bytes
 
 
 /*---------------------------------------------------------------------------*/
-// encrypt 64 bytes ussing AES128 CBC
-void encrypt_cbc(uint8_t* data_encrypted, uint8_t* data, uint8_t* key, uint8_t* iv) { 
-    //PRINTF("Data input: \n");
-    //phex_64(data);
-    
-    //encrypte 4 rows, each row has 16 bytes
-    AES128_CBC_encrypt_buffer(data_encrypted+0, data+0, 16, key, iv);
-    AES128_CBC_encrypt_buffer(data_encrypted+16, data+16, 16, key, iv);
-    //AES128_CBC_encrypt_buffer(data_encrypted+32, data+32, 16, key, iv);
-    //AES128_CBC_encrypt_buffer(data_encrypted+48, data+48, 16, key, iv);
+/* key schedule of the app key, expanded once per key */
+static aes128_ctx app_ctx;
+static uint8_t app_ctx_ready = FALSE;
 
-    //PRINTF("\nData encrypted: \n");
-    //phex_64(data_encrypted);
+/*---------------------------------------------------------------------------*/
+void set_app_key(const uint8_t* key) {
+    AES128_init_ctx(&app_ctx, key);
+    app_ctx_ready = TRUE;
 }
 
 /*---------------------------------------------------------------------------*/
-void  decrypt_cbc(uint8_t* data_decrypted, uint8_t* data_encrypted, uint8_t* key, uint8_t* iv)  {    
-    //PRINTF("\nData encrypted: \n");
-    //phex_64(data_encrypted);
+// returns the cached schedule, re-expanding only if the key changed
+aes128_ctx* get_app_ctx(const uint8_t* key) {
+    if ((app_ctx_ready==FALSE) || (memcmp(app_ctx.Key, key, 16) != 0))
+        set_app_key(key);
+    return &app_ctx;
+}
 
-    AES128_CBC_decrypt_buffer(data_decrypted+0,  data_encrypted+0,  16, key, iv);
-    AES128_CBC_decrypt_buffer(data_decrypted+16, data_encrypted+16, 16, key, iv);
-    //AES128_CBC_decrypt_buffer(data_decrypted+32, data_encrypted+32, 16, key, iv);
-    //AES128_CBC_decrypt_buffer(data_decrypted+48, data_encrypted+48, 16, key, iv);
-    
-    //PRINTF("Data decrypted: \n");
-    //phex_64(data_decrypted);
+/*---------------------------------------------------------------------------*/
+// encrypt 32 bytes ussing AES128 CBC: each 16-byte row starts again from iv
+void encrypt_cbc(uint8_t* data_encrypted, const uint8_t* data, aes128_ctx* ctx, const uint8_t* iv) { 
+    //encrypte 2 rows, each row has 16 bytes
+    AES128_ctx_set_iv(ctx, iv);
+    AES128_CBC_encrypt_buffer_ctx(ctx, data_encrypted+0, data+0, 16);
+    AES128_ctx_set_iv(ctx, iv);
+    AES128_CBC_encrypt_buffer_ctx(ctx, data_encrypted+16, data+16, 16);
+}
+
+/*---------------------------------------------------------------------------*/
+void  decrypt_cbc(uint8_t* data_decrypted, const uint8_t* data_encrypted, aes128_ctx* ctx, const uint8_t* iv)  {    
+    AES128_ctx_set_iv(ctx, iv);
+    AES128_CBC_decrypt_buffer_ctx(ctx, data_decrypted+0,  data_encrypted+0,  16);
+    AES128_ctx_set_iv(ctx, iv);
+    AES128_CBC_decrypt_buffer_ctx(ctx, data_decrypted+16, data_encrypted+16, 16);
+}
+
+
+/*---------------------------------------------------------------------------*/
+/* ENCRYPTION_MODE 3: AES-CCM (RFC 3610) with a 2-byte length field and a CCM_MIC_LEN MIC.
+   sfd, len, seq, type stay in clear and are bound to the MIC through the nonce,
+   with the node and salt of the session (ccm_session_t, sls.h);
+   cmd, err_code and the first CCM_DATA_LEN arg bytes are encrypted in place; the MIC
+   takes the last arg bytes and the CRC. */
+#define CCM_L			2
+#define CCM_HDR_LEN		5
+#define CCM_BODY_LEN	(MAX_CMD_LEN - CCM_HDR_LEN - CCM_MIC_LEN)
+#define CCM_MIC(cmd)	((uint8_t *)(cmd) + CCM_HDR_LEN + CCM_BODY_LEN)
+
+#ifdef SLS_GATEWAY_SIDE
+#define CCM_TX_DIR		CCM_DIR_DOWNLINK
+#define CCM_RX_DIR		CCM_DIR_UPLINK
+#else
+#define CCM_TX_DIR		CCM_DIR_UPLINK
+#define CCM_RX_DIR		CCM_DIR_DOWNLINK
+#endif
+
+/*---------------------------------------------------------------------------*/
+// B0 / A_i block: flags | nonce = (dir, len, seq, type, node, salt) | count
+static void ccm_block(uint8_t* blk, uint8_t flags, const uint8_t* frame, uint8_t dir, const ccm_session_t* ses, uint16_t count) {
+    blk[0] = flags;
+    blk[1] = dir;
+    memcpy(&blk[2], &frame[1], CCM_HDR_LEN-1);
+    memcpy(&blk[1+CCM_HDR_LEN], ses->node, CCM_NODE_LEN);
+    memcpy(&blk[1+CCM_HDR_LEN+CCM_NODE_LEN], ses->salt, CCM_SALT_LEN);
+    blk[14] = count >> 8;
+    blk[15] = count & 0xFF;
+}
+
+#if SLS_HW_CRYPTO
+/*---------------------------------------------------------------------------*/
+/* CC2538 crypto engine. Key area 0 is used by LLSEC (cc2538_aes_128_driver) */
+#define SLS_AES_KEY_AREA	1
+#define HW_CCM_UNAVAILABLE	0xFF
+
+static uint8_t hw_key[16];
+static uint8_t hw_key_ready = FALSE;
+
+/*---------------------------------------------------------------------------*/
+// the key store does not survive crypto_disable() nor PM2/PM3: the key loaded last
+// is only trusted while the engine stayed on and LPM cannot go below PM1
+static uint8_t hw_key_loaded(const aes128_ctx* ctx) {
+#if (LPM_CONF_ENABLE && (LPM_CONF_MAX_PM >= 2))
+    return FALSE;
+#else
+    return (hw_key_ready==TRUE) && crypto_is_enabled() && (memcmp(hw_key, ctx->Key, 16)==0);
+#endif
+}
+
+/*---------------------------------------------------------------------------*/
+static uint8_t hw_load_key(const aes128_ctx* ctx) {
+    if (hw_key_loaded(ctx)==TRUE)
+        return TRUE;
+    hw_key_ready = FALSE;
+    crypto_enable();
+    if (aes_load_keys(ctx->Key, AES_KEY_STORE_SIZE_KEY_SIZE_128, 1, SLS_AES_KEY_AREA) != CRYPTO_SUCCESS) {
+        LOG0(EV_HW_KEY_FAIL);
+        return FALSE;
+    }
+    memcpy(hw_key, ctx->Key, 16);
+    hw_key_ready = TRUE;
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------*/
+// same frame layout and nonce as ccm_crypt(); the engine expects the MIC right
+// behind the body, as both frame formats carry it.
+// returns TRUE/FALSE like ccm_crypt(), or HW_CCM_UNAVAILABLE if the engine could not run
+static uint8_t hw_ccm_crypt(uint8_t* frame, uint8_t body_len, uint8_t* mic, aes128_ctx* ctx, const ccm_session_t* ses, uint8_t dir, uint8_t encrypt) {
+    uint8_t blk[16], tag[CCM_MIC_LEN];
+    uint8_t ret;
+
+    if ((mic != frame + CCM_HDR_LEN + body_len) || (hw_load_key(ctx)==FALSE))
+        return HW_CCM_UNAVAILABLE;
+    ccm_block(blk, 0, frame, dir, ses, 0);
+
+    if (encrypt) {
+        ret = ccm_auth_encrypt_start(CCM_L, SLS_AES_KEY_AREA, &blk[1], NULL, 0,
+                                     frame + CCM_HDR_LEN, body_len, CCM_MIC_LEN, NULL);
+        if (ret != CRYPTO_SUCCESS)
+            return HW_CCM_UNAVAILABLE;
+        while (!ccm_auth_encrypt_check_status());
+        return (ccm_auth_encrypt_get_result(mic, CCM_MIC_LEN) == CRYPTO_SUCCESS);
+    }
+
+    ret = ccm_auth_decrypt_start(CCM_L, SLS_AES_KEY_AREA, &blk[1], NULL, 0,
+                                 frame + CCM_HDR_LEN, body_len + CCM_MIC_LEN, CCM_MIC_LEN, NULL);
+    if (ret != CRYPTO_SUCCESS)
+        return HW_CCM_UNAVAILABLE;
+    while (!ccm_auth_decrypt_check_status());
+    return (ccm_auth_decrypt_get_result(frame + CCM_HDR_LEN, body_len + CCM_MIC_LEN, tag, CCM_MIC_LEN) == CRYPTO_SUCCESS);
+}
+#endif /* SLS_HW_CRYPTO */
+
+/*---------------------------------------------------------------------------*/
+// one pass over the body: CBC-MAC and CTR are interleaved block by block.
+// encrypt: writes the MIC to mic; decrypt: returns TRUE if mic matches.
+static uint8_t ccm_crypt(uint8_t* frame, uint8_t body_len, uint8_t* mic, aes128_ctx* ctx, const ccm_session_t* ses, uint8_t dir, uint8_t encrypt) {
+    uint8_t x[16], s[16];
+    uint8_t *p = frame + CCM_HDR_LEN;
+    uint8_t i, n, diff = 0;
+    uint16_t ctr = 1;
+
+    ccm_block(x, (((CCM_MIC_LEN-2)/2) << 3) | (CCM_L-1), frame, dir, ses, body_len);
+    AES128_ECB_encrypt_ctx(ctx, x);
+
+    while (body_len > 0) {
+        n = (body_len < 16) ? body_len : 16;
+        ccm_block(s, CCM_L-1, frame, dir, ses, ctr++);
+        AES128_ECB_encrypt_ctx(ctx, s);
+        for (i=0; i<n; i++) {
+            if (encrypt) { x[i] ^= p[i]; p[i] ^= s[i]; }
+            else         { p[i] ^= s[i]; x[i] ^= p[i]; }
+        }
+        AES128_ECB_encrypt_ctx(ctx, x);
+        p += n;
+        body_len -= n;
+    }
+
+    ccm_block(s, CCM_L-1, frame, dir, ses, 0);
+    AES128_ECB_encrypt_ctx(ctx, s);
+    for (i=0; i<CCM_MIC_LEN; i++) {
+        if (encrypt) mic[i] = x[i] ^ s[i];
+        else diff |= mic[i] ^ x[i] ^ s[i];
+    }
+    return (diff == 0);
+}
+
+/*---------------------------------------------------------------------------*/
+// hardware CCM when the platform has it, software otherwise
+static uint8_t ccm_run(uint8_t* frame, uint8_t body_len, uint8_t* mic, aes128_ctx* ctx, const ccm_session_t* ses, uint8_t dir, uint8_t encrypt) {
+#if SLS_HW_CRYPTO
+    uint8_t ret = hw_ccm_crypt(frame, body_len, mic, ctx, ses, dir, encrypt);
+    if (ret != HW_CCM_UNAVAILABLE)
+        return ret;
+#endif
+    return ccm_crypt(frame, body_len, mic, ctx, ses, dir, encrypt);
 }
 
 
@@ -139,33 +602,524 @@ uint16_t hash(uint16_t a) {
 
 
 /*---------------------------------------------------------------------------*/
-void encrypt_payload(cmd_struct_t *cmd, uint8_t* key) {
-    uint8_t payload[MAX_CMD_LEN];    
-    
+// ses: CCM nonce of the session, only used in ENCRYPTION_MODE 3, where the MIC
+// overwrites the arg bytes past CCM_DATA_LEN
+void encrypt_payload_ctx(cmd_struct_t *cmd, aes128_ctx* ctx, const ccm_session_t *ses) {
     if (ENCRYPTION_MODE==1){
-        scramble_data((uint8_t *)cmd, (uint8_t *)cmd, key);
-        PRINTF(" - Scramble data ... done \n");
+        scramble_data((uint8_t *)cmd, (uint8_t *)cmd, ctx->Key);
+        LOG0(EV_SCRAMBLE);
     }
     else if (ENCRYPTION_MODE==2) {
-        memcpy(&payload, cmd, MAX_CMD_LEN);
-        encrypt_cbc((uint8_t *)cmd, payload, key, iv);
-        PRINTF(" - Encrypt AES128-CBC ... done \n");
+        encrypt_cbc((uint8_t *)cmd, (uint8_t *)cmd, ctx, iv);
+        LOG0(EV_ENC_CBC);
     }
+    else if (ENCRYPTION_MODE==3) {
+        cmd->sfd = SFD_CCM;
+        ccm_run((uint8_t *)cmd, CCM_BODY_LEN, CCM_MIC(cmd), ctx, ses, CCM_TX_DIR, TRUE);
+        LOG0(EV_ENC_CCM);
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+void encrypt_payload(cmd_struct_t *cmd, uint8_t* key, const ccm_session_t *ses) {
+    encrypt_payload_ctx(cmd, get_app_ctx(key), ses);
 }
 
 
-/*-----------------------0x%02X----------------------------------------------------*/
-void decrypt_payload(cmd_struct_t *cmd, uint8_t* key) {
+/*---------------------------------------------------------------------------*/
+// returns FALSE if the frame must be dropped (ENCRYPTION_MODE 3: bad MIC)
+uint8_t decrypt_payload_ctx(cmd_struct_t *cmd, aes128_ctx* ctx, const ccm_session_t *ses) {
     if (ENCRYPTION_MODE==1) {
-        descramble_data((uint8_t *)cmd, (uint8_t *)cmd, key);
-        PRINTF(" - Descramble data ... done \n");
+        descramble_data((uint8_t *)cmd, (uint8_t *)cmd, ctx->Key);
+        LOG0(EV_DESCRAMBLE);
     }
     else if (ENCRYPTION_MODE==2) {
-        decrypt_cbc((uint8_t *)cmd, (uint8_t *)cmd, key, iv);
-        PRINTF(" - Decrypt AES128-CBC ... done \n");
+        decrypt_cbc((uint8_t *)cmd, (uint8_t *)cmd, ctx, iv);
+        LOG0(EV_DEC_CBC);
+    }
+    else if (ENCRYPTION_MODE==3) {
+        if ((cmd->sfd != SFD_CCM) ||
+            (ccm_run((uint8_t *)cmd, CCM_BODY_LEN, CCM_MIC(cmd), ctx, ses, CCM_RX_DIR, FALSE)==FALSE)) {
+            LOG0(EV_DEC_CCM_FAIL);
+            return FALSE;
+        }
+        cmd->sfd = SFD;
+        memset(&cmd->arg[CCM_DATA_LEN], 0, MAX_CMD_DATA_LEN - CCM_DATA_LEN);   // under the MIC; crc keeps its end
+        LOG0(EV_DEC_CCM);
+    }
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------*/
+uint8_t decrypt_payload(cmd_struct_t *cmd, uint8_t* key, const ccm_session_t *ses) {
+    return decrypt_payload_ctx(cmd, get_app_ctx(key), ses);
+}
+
+/*---------------------------------------------------------------------------*/
+// arg bytes carried by a compact frame: trailing zero bytes are left out
+uint8_t compact_arg_len(const cmd_struct_t *cmd) {
+    uint8_t n = MAX_CMD_DATA_LEN;
+    while ((n > 0) && (cmd->arg[n-1] == 0))
+        n--;
+    return n;
+}
+
+/*---------------------------------------------------------------------------*/
+// writes cmd with arg_len arg bytes as a compact frame into buf (MAX_FRAME_LEN bytes, or cmd
+// itself when the frame fits in MAX_CMD_LEN) and returns its length; 0 if the frame cannot
+// be protected this way (ENCRYPTION_MODE 1, 2)
+uint8_t make_compact_frame(uint8_t *buf, const cmd_struct_t *cmd, uint8_t arg_len, uint8_t* key, const ccm_session_t *ses, uint8_t encryption_en) {
+    uint8_t n = COMPACT_HDR_LEN + arg_len;
+    uint8_t type = cmd->type, id = cmd->cmd, err_code = cmd->err_code;
+    uint16_t seq = cmd->seq, crc;
+
+    if ((arg_len > MAX_CMD_DATA_LEN) ||
+        ((encryption_en==TRUE) && (ENCRYPTION_MODE!=0) && (ENCRYPTION_MODE!=3)))
+        return 0;
+
+    memmove(&buf[COMPACT_HDR_LEN], cmd->arg, arg_len);
+    buf[0] = SFD_COMPACT;
+    buf[1] = arg_len;
+    buf[2] = seq & 0xFF;
+    buf[3] = seq >> 8;
+    buf[4] = type;
+    buf[5] = id;
+    buf[6] = err_code;
+
+    if ((encryption_en==TRUE) && (ENCRYPTION_MODE==3)) {
+        buf[0] = SFD_COMPACT_CCM;
+        ccm_run(buf, n - CCM_HDR_LEN, &buf[n], get_app_ctx(key), ses, CCM_TX_DIR | CCM_DIR_COMPACT, TRUE);
+        LOG0(EV_ENC_CCM);
+        return COMPACT_CCM_FRAME_LEN(arg_len);
+    }
+    crc = gen_crc16(buf, n);
+    buf[n] = crc & 0xFF;
+    buf[n+1] = crc >> 8;
+    LOG(EV_CRC_GEN, crc);
+    return COMPACT_FRAME_LEN(arg_len);
+}
+
+/*---------------------------------------------------------------------------*/
+// checks (CRC or MIC) a compact frame of len bytes and expands it into cmd, unused arg
+// bytes zeroed; cmd may be buf, which then needs MAX_FRAME_LEN bytes. FALSE: drop it
+uint8_t parse_compact_frame(cmd_struct_t *cmd, uint8_t *buf, uint16_t len, uint8_t* key, const ccm_session_t *ses, uint8_t encryption_en) {
+    uint8_t n, arg_len = buf[1];
+    uint8_t type, id, err_code;
+    uint16_t seq, crc;
+
+    if ((len < COMPACT_FRAME_LEN(0)) || (arg_len > MAX_CMD_DATA_LEN) ||
+        (len != ((buf[0] == SFD_COMPACT_CCM) ? COMPACT_CCM_FRAME_LEN(arg_len) : COMPACT_FRAME_LEN(arg_len))))
+        return FALSE;
+    n = COMPACT_HDR_LEN + arg_len;
+    crc = buf[n] | (buf[n+1] << 8);
+
+    if (buf[0] == SFD_COMPACT_CCM) {
+        if ((encryption_en==FALSE) || (ENCRYPTION_MODE!=3) ||
+            (ccm_run(buf, n - CCM_HDR_LEN, &buf[n], get_app_ctx(key), ses, CCM_RX_DIR | CCM_DIR_COMPACT, FALSE)==FALSE)) {
+            LOG0(EV_DEC_CCM_FAIL);
+            return FALSE;
+        }
+        LOG0(EV_DEC_CCM);
+    } else if (buf[0] == SFD_COMPACT) {
+        if (gen_crc16(buf, n) != crc) {
+            LOG(EV_CRC_FAIL, gen_crc16(buf, n), crc);
+            return FALSE;
+        }
+        LOG0(EV_CRC_OK);
+    } else {
+        return FALSE;
+    }
+
+    seq = buf[2] | (buf[3] << 8);
+    type = buf[4];
+    id = buf[5];
+    err_code = buf[6];
+    memmove(cmd->arg, &buf[COMPACT_HDR_LEN], arg_len);
+    memset(&cmd->arg[arg_len], 0, MAX_CMD_DATA_LEN - arg_len);
+    cmd->sfd = SFD;
+    cmd->len = arg_len;
+    cmd->seq = seq;
+    cmd->type = type;
+    cmd->cmd = id;
+    cmd->err_code = err_code;
+    cmd->crc = crc;
+    return TRUE;
+}
+
+
+#if AES_BATCH
+/*---------------------------------------------------------------------------*/
+/* Batch calls for the gateway: frame i with ctx[i] and, in mode 3, ses[i]. The AES blocks of a chunk of
+   frames go through AES128_ECB_*_batch together; CCM needs one call for the
+   B0/counter blocks and one per body block for the CBC-MAC chain. */
+#define SLS_BATCH_CHUNK	32
+#define CCM_BODY_BLKS	((CCM_BODY_LEN + 15) / 16)
+
+/*---------------------------------------------------------------------------*/
+// mode 2: each 16-byte row is one CBC block from iv, so all rows are independent
+static void cbc_rows_batch(cmd_struct_t *cmd, const aes128_ctx* const* ctx, uint16_t n, uint8_t encrypt) {
+    const aes128_ctx* kc[2*SLS_BATCH_CHUNK];
+    uint8_t* blk[2*SLS_BATCH_CHUNK];
+    uint16_t i, k;
+    uint8_t j;
+
+    for (i=0; i<2*n; i++) {
+        kc[i] = ctx[i/2];
+        blk[i] = (uint8_t *)&cmd[i/2] + 16*(i%2);
+        if (encrypt)
+            for (j=0; j<16; j++) blk[i][j] ^= iv[j];
+    }
+    if (encrypt) {
+        AES128_ECB_encrypt_batch(kc, blk, 2*n);
+        return;
+    }
+    AES128_ECB_decrypt_batch(kc, blk, 2*n);
+    for (k=0; k<2*n; k++)
+        for (j=0; j<16; j++) blk[k][j] ^= iv[j];
+}
+
+/*---------------------------------------------------------------------------*/
+// mode 3: same result as ccm_crypt() on each frame
+static void ccm_batch(cmd_struct_t *cmd, const aes128_ctx* const* ctx, const ccm_session_t* const* ses, uint16_t n, uint8_t encrypt, uint8_t* ok) {
+    uint8_t x[SLS_BATCH_CHUNK][16];
+    uint8_t s[SLS_BATCH_CHUNK][CCM_BODY_BLKS+1][16];
+    const aes128_ctx* kc[SLS_BATCH_CHUNK*(CCM_BODY_BLKS+2)];
+    uint8_t* blk[SLS_BATCH_CHUNK*(CCM_BODY_BLKS+2)];
+    uint8_t dir = encrypt ? CCM_TX_DIR : CCM_RX_DIR;
+    uint8_t *frame, *p, *mic;
+    uint16_t i, k = 0;
+    uint8_t b, j, len, diff;
+
+    // B0 and the counter blocks A0..An do not depend on each other
+    for (i=0; i<n; i++) {
+        frame = (uint8_t *)&cmd[i];
+        if (encrypt)
+            cmd[i].sfd = SFD_CCM;
+        ccm_block(x[i], (((CCM_MIC_LEN-2)/2) << 3) | (CCM_L-1), frame, dir, ses[i], CCM_BODY_LEN);
+        kc[k] = ctx[i]; blk[k++] = x[i];
+        for (b=0; b<=CCM_BODY_BLKS; b++) {
+            ccm_block(s[i][b], CCM_L-1, frame, dir, ses[i], b);
+            kc[k] = ctx[i]; blk[k++] = s[i][b];
+        }
+    }
+    AES128_ECB_encrypt_batch(kc, blk, k);
+
+    // CBC-MAC and CTR, one body block of every frame per step
+    for (b=0; b<CCM_BODY_BLKS; b++) {
+        len = (b < CCM_BODY_BLKS-1) ? 16 : CCM_BODY_LEN - 16*b;
+        for (i=0; i<n; i++) {
+            p = (uint8_t *)&cmd[i] + CCM_HDR_LEN + 16*b;
+            for (j=0; j<len; j++) {
+                if (encrypt) { x[i][j] ^= p[j]; p[j] ^= s[i][b+1][j]; }
+                else         { p[j] ^= s[i][b+1][j]; x[i][j] ^= p[j]; }
+            }
+            kc[i] = ctx[i]; blk[i] = x[i];
+        }
+        AES128_ECB_encrypt_batch(kc, blk, n);
+    }
+
+    for (i=0; i<n; i++) {
+        mic = CCM_MIC(&cmd[i]);
+        diff = 0;
+        for (j=0; j<CCM_MIC_LEN; j++) {
+            if (encrypt) mic[j] = x[i][j] ^ s[i][0][j];
+            else diff |= mic[j] ^ x[i][j] ^ s[i][0][j];
+        }
+        if (!encrypt) {
+            ok[i] = (diff == 0) && (cmd[i].sfd == SFD_CCM);
+            if (ok[i]) {
+                cmd[i].sfd = SFD;
+                memset(&cmd[i].arg[CCM_DATA_LEN], 0, MAX_CMD_DATA_LEN - CCM_DATA_LEN);
+            }
+        }
     }
 }
 
+/*---------------------------------------------------------------------------*/
+void encrypt_payload_batch(cmd_struct_t *cmd, const aes128_ctx* const* ctx, const ccm_session_t* const* ses, uint16_t n) {
+    uint16_t i, m;
+
+    for (; n > 0; n -= m, cmd += m, ctx += m, ses += m) {
+        m = (n < SLS_BATCH_CHUNK) ? n : SLS_BATCH_CHUNK;
+        if (ENCRYPTION_MODE==1) {
+            for (i=0; i<m; i++)
+                scramble_data((uint8_t *)&cmd[i], (uint8_t *)&cmd[i], ctx[i]->Key);
+        }
+        else if (ENCRYPTION_MODE==2) {
+            cbc_rows_batch(cmd, ctx, m, TRUE);
+        }
+        else if (ENCRYPTION_MODE==3) {
+            ccm_batch(cmd, ctx, ses, m, TRUE, NULL);
+        }
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+// ok[i] as decrypt_payload_ctx() returns it; frames with ok[i]==FALSE must be dropped
+void decrypt_payload_batch(cmd_struct_t *cmd, const aes128_ctx* const* ctx, const ccm_session_t* const* ses, uint16_t n, uint8_t* ok) {
+    uint16_t i, m;
+
+    for (; n > 0; n -= m, cmd += m, ctx += m, ses += m, ok += m) {
+        m = (n < SLS_BATCH_CHUNK) ? n : SLS_BATCH_CHUNK;
+        for (i=0; i<m; i++)
+            ok[i] = TRUE;
+        if (ENCRYPTION_MODE==1) {
+            for (i=0; i<m; i++)
+                descramble_data((uint8_t *)&cmd[i], (uint8_t *)&cmd[i], ctx[i]->Key);
+        }
+        else if (ENCRYPTION_MODE==2) {
+            cbc_rows_batch(cmd, ctx, m, FALSE);
+        }
+        else if (ENCRYPTION_MODE==3) {
+            ccm_batch(cmd, ctx, ses, m, FALSE, ok);
+        }
+    }
+}
+#endif /* AES_BATCH */
+
+
+
+/*---------------------------------------------------------------------------*/
+void seq_window_reset(seq_window_struct_t *w) {
+    w->top = 0;
+    w->map = 0;
+}
+
+/*---------------------------------------------------------------------------*/
+// TRUE and recorded if seq is new; serial arithmetic, so the uint16 seq may wrap
+// and seqs up to SEQ_WINDOW_SIZE-1 behind the newest may arrive out of order
+uint8_t seq_window_check(seq_window_struct_t *w, uint16_t seq) {
+    int16_t d = (int16_t)(seq - w->top);
+    uint16_t back = w->top - seq;       /* 0x8000 is behind: -d would overflow */
+
+    if ((w->map == 0) || (d > 0)) {
+        if (w->map == 0) {
+            w->map = 1;
+        } else {
+            w->map = (d < SEQ_WINDOW_SIZE) ? ((w->map << d) | 1) : 1;
+        }
+        w->top = seq;
+        return TRUE;
+    }
+    if ((back >= SEQ_WINDOW_SIZE) || (w->map & ((seq_map_t)1 << back))) {
+        return FALSE;
+    }
+    w->map |= ((seq_map_t)1 << back);
+    return TRUE;
+}
+
+
+/*---------------------------------------------------------------------------*/
+// forgets the replies; a slot taken by reply_cache_add() can still be filled
+void reply_cache_reset(reply_cache_struct_t *c) {
+    uint8_t i;
+    for (i=0; i<REPLY_CACHE_LEN; i++) {
+        c->entry[i].valid = FALSE;
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+// the reply already sent for this request, NULL if none
+reply_cache_entry_t* reply_cache_find(reply_cache_struct_t *c, const cmd_struct_t *req) {
+    reply_cache_entry_t *e;
+    uint8_t i;
+
+    for (i=0; i<REPLY_CACHE_LEN; i++) {
+        e = &c->entry[i];
+        if ((e->valid == TRUE) && (e->seq == req->seq) && (e->type == req->type) &&
+            (e->cmd == req->cmd) && (e->req_crc == req->crc)) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+// takes the oldest slot for the reply to req, filled by reply_cache_fill() once sent
+reply_cache_entry_t* reply_cache_add(reply_cache_struct_t *c, const cmd_struct_t *req) {
+    reply_cache_entry_t *e = &c->entry[c->next];
+
+    c->next = (c->next + 1) % REPLY_CACHE_LEN;
+    e->seq = req->seq;
+    e->type = req->type;
+    e->cmd = req->cmd;
+    e->req_crc = req->crc;
+    e->valid = FALSE;
+    return e;
+}
+
+/*---------------------------------------------------------------------------*/
+void reply_cache_fill(reply_cache_entry_t *e, const uint8_t *frame, uint8_t len) {
+    memcpy(e->frame, frame, len);
+    e->frame_len = len;
+    e->valid = TRUE;
+}
+
+
+/*---------------------------------------------------------------------------*/
+// window statistics into the SENSOR_AGG_LEN bytes of arg: per field the smallest
+// shift that brings min, max and last within an int8 around the mean
+void sensor_agg_pack(uint8_t *arg, const sensor_agg_t *agg) {
+    uint8_t f, s, *p = &arg[SENSOR_AGG_HDR_LEN];
+    int32_t mean;
+
+    arg[0] = agg->n;
+    arg[1] = arg[2] = 0;
+    for (f=0; f<SENSOR_FIELDS; f++) {
+        mean = agg->mean[f];
+        s = 0;
+        while ((((agg->max[f] - mean) >> s) > 127) || (((agg->min[f] - mean) >> s) < -128))
+            s++;
+        arg[1 + f/2] |= (f & 1) ? s : (s << 4);
+        p[0] = (mean >> 8) & 0xFF;
+        p[1] = mean & 0xFF;
+        p[2] = (uint8_t)((agg->min[f] - mean) >> s);
+        p[3] = (uint8_t)((agg->max[f] - mean) >> s);
+        p[4] = (uint8_t)((agg->last[f] - mean) >> s);
+        p += 5;
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+// ASYNC_MSG_SENSOR_AGG arg back to values, min/max/last to within 2^shift below
+void sensor_agg_unpack(sensor_agg_t *agg, const uint8_t *arg) {
+    const uint8_t *p = &arg[SENSOR_AGG_HDR_LEN];
+    uint8_t f, s;
+    int32_t mean;
+
+    agg->n = arg[0];
+    for (f=0; f<SENSOR_FIELDS; f++) {
+        s = (f & 1) ? (arg[1 + f/2] & 0x0F) : (arg[1 + f/2] >> 4);
+        mean = ((uint16_t)p[0] << 8) | p[1];
+        if (SENSOR_SIGNED & (1 << f))
+            mean = (int16_t)mean;
+        agg->mean[f] = mean;
+        agg->min[f] = mean + (int32_t)(int8_t)p[2] * (1L << s);
+        agg->max[f] = mean + (int32_t)(int8_t)p[3] * (1L << s);
+        agg->last[f] = mean + (int32_t)(int8_t)p[4] * (1L << s);
+        p += 5;
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+// value i of a report: the min of each field, then max, mean, last
+static int32_t* sensor_agg_value(sensor_agg_t *agg, uint8_t i) {
+    switch (i / SENSOR_FIELDS) {
+    case 0:     return &agg->min[i % SENSOR_FIELDS];
+    case 1:     return &agg->max[i % SENSOR_FIELDS];
+    case 2:     return &agg->mean[i % SENSOR_FIELDS];
+    default:    return &agg->last[i % SENSOR_FIELDS];
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+// ASYNC_MSG_SENSOR_DELTA arg: the values of agg that differ from ref, base is the seq of ref;
+// returns the arg length, 0 if the changes do not fit
+uint8_t sensor_delta_pack(uint8_t *arg, const sensor_agg_t *agg, const sensor_agg_t *ref, uint8_t base) {
+    uint8_t i, n = SENSOR_DELTA_HDR_LEN;
+    uint16_t present = 0;
+    int32_t d;
+    uint32_t z;
+
+    for (i=0; i<SENSOR_VALUES; i++) {
+        d = *sensor_agg_value((sensor_agg_t *)agg, i) - *sensor_agg_value((sensor_agg_t *)ref, i);
+        if (d == 0)
+            continue;
+        present |= (1U << i);
+        z = (d < 0) ? ((uint32_t)(-d) << 1) - 1 : (uint32_t)d << 1;
+        do {
+            if (n == MAX_CMD_DATA_LEN)
+                return 0;
+            arg[n++] = (z & 0x7F) | ((z > 0x7F) ? 0x80 : 0);
+            z >>= 7;
+        } while (z != 0);
+    }
+    arg[0] = agg->n;
+    arg[1] = base;
+    arg[2] = present >> 8;
+    arg[3] = present & 0xFF;
+    return n;
+}
+
+#ifdef SLS_GATEWAY_SIDE
+/*---------------------------------------------------------------------------*/
+// ACK for a received ASYNC msg, sent back to the source port of the node
+void make_async_ack(cmd_struct_t *ack, const cmd_struct_t *async) {
+    memset(ack, 0, sizeof(cmd_struct_t));
+    ack->sfd = SFD;
+    ack->len = async->len;
+    ack->seq = async->seq;
+    ack->type = MSG_TYPE_ASYNC_ACK;
+    ack->cmd = async->cmd;
+    ack->err_code = ERR_NORMAL;
+}
+
+/*---------------------------------------------------------------------------*/
+// TRUE if (node, seq) was received before, otherwise it is remembered;
+// node is the 8-byte interface id, a full table reuses its slots in turn
+uint8_t async_rx_duplicate(async_rx_struct_t *tab, uint8_t size, const uint8_t *node, uint16_t seq) {
+    static uint8_t victim;
+    async_rx_struct_t *e = NULL;
+    uint8_t i;
+
+    for (i=0; i<size; i++) {
+        if ((tab[i].used > 0) && (memcmp(tab[i].node, node, 8)==0)) {
+            e = &tab[i];
+            break;
+        }
+        if ((e == NULL) && (tab[i].used == 0)) {
+            e = &tab[i];
+        }
+    }
+    if (e == NULL) {
+        e = &tab[victim];
+        victim = (victim + 1) % size;
+    }
+    if ((e->used == 0) || (memcmp(e->node, node, 8) != 0)) {
+        memcpy(e->node, node, 8);
+        e->used = 0;
+        e->next = 0;
+    }
+
+    for (i=0; i<e->used; i++) {
+        if (e->seq[i] == seq) {
+            return TRUE;
+        }
+    }
+    e->seq[e->next] = seq;
+    e->next = (e->next + 1) % ASYNC_DEDUP_DEPTH;
+    if (e->used < ASYNC_DEDUP_DEPTH) {
+        e->used++;
+    }
+    return FALSE;
+}
+
+/*---------------------------------------------------------------------------*/
+// ASYNC_MSG_SENSOR_DELTA arg back to values, ref is the report whose seq ends in arg[1];
+// FALSE if the varints run past arg
+uint8_t sensor_delta_unpack(sensor_agg_t *agg, const sensor_agg_t *ref, const uint8_t *arg) {
+    uint16_t present = (arg[2] << 8) | arg[3];
+    uint8_t i, s, n = SENSOR_DELTA_HDR_LEN;
+    uint32_t z;
+
+    *agg = *ref;
+    agg->n = arg[0];
+    for (i=0; i<SENSOR_VALUES; i++) {
+        if ((present & (1U << i)) == 0)
+            continue;
+        z = 0;
+        s = 0;
+        do {
+            if ((n == MAX_CMD_DATA_LEN) || (s > 28))
+                return FALSE;
+            z |= (uint32_t)(arg[n] & 0x7F) << s;
+            s += 7;
+        } while (arg[n++] & 0x80);
+        *sensor_agg_value(agg, i) += (z & 1) ? -(int32_t)(z >> 1) - 1 : (int32_t)(z >> 1);
+    }
+    return TRUE;
+}
+#endif /* SLS_GATEWAY_SIDE */
 
 
 //float float_example = 1.11;
@@ -184,7 +1138,7 @@ void float2Bytes(float val, uint8_t* bytes_array){
 
 /*---------------------------------------------------------------------------*/
 // scramble data with a key
-void scramble_data(uint8_t* data_encrypted, uint8_t* data, uint8_t* key) {
+void scramble_data(uint8_t* data_encrypted, uint8_t* data, const uint8_t* key) {
     int i;
     for (i=0; i<MAX_CMD_LEN; i++) {
         data_encrypted[i] = data[i] ^ key[i % 4];
@@ -193,7 +1147,7 @@ void scramble_data(uint8_t* data_encrypted, uint8_t* data, uint8_t* key) {
 
 /*---------------------------------------------------------------------------*/
 // descramble data with a key
-void descramble_data(uint8_t* data_decrypted, uint8_t* data_encrypted, uint8_t* key) {
+void descramble_data(uint8_t* data_decrypted, uint8_t* data_encrypted, const uint8_t* key) {
     int i;
     for (i=0; i<MAX_CMD_LEN; i++) {
         data_decrypted[i] = data_encrypted[i] ^ key[i % 4];
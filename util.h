@@ -9,6 +9,8 @@
 | HW support in ISM band: TelosB, CC2538, CC2530, CC1310, z1        |
 |-------------------------------------------------------------------|*/
 
+#include "aes_lib.h"
+
 
 void phex_16(uint8_t* data_16);
 void phex_64(uint8_t* data_64);
@@ -16,11 +18,39 @@ uint16_t 	hash( uint16_t a);
 void		gen_crc_for_cmd(cmd_struct_t *cmd);
 uint8_t 	check_crc_for_cmd(cmd_struct_t *cmd);
 uint16_t 	gen_crc16(uint8_t *data_p, unsigned short  length);
-void 		encrypt_cbc(uint8_t* data_encrypted, uint8_t* data, uint8_t* key, uint8_t* iv);
-void 		decrypt_cbc(uint8_t* data_encrypted, uint8_t* data, uint8_t* key, uint8_t* iv);
-void 		encrypt_payload(cmd_struct_t *cmd, uint8_t* key);
-void 		decrypt_payload(cmd_struct_t *cmd, uint8_t* key);
-void    	scramble_data(uint8_t* data_encrypted, uint8_t* data, uint8_t* key);
-void    	descramble_data(uint8_t* data_decrypted, uint8_t* data_encrypted, uint8_t* key);
+uint16_t 	gen_crc16_init(void);
+uint16_t 	gen_crc16_update(uint16_t crc, const uint8_t *data_p, uint16_t length);
+uint16_t 	gen_crc16_final(uint16_t crc);
+void 		set_app_key(const uint8_t* key);
+aes128_ctx*	get_app_ctx(const uint8_t* key);
+void 		encrypt_cbc(uint8_t* data_encrypted, const uint8_t* data, aes128_ctx* ctx, const uint8_t* iv);
+void 		decrypt_cbc(uint8_t* data_decrypted, const uint8_t* data_encrypted, aes128_ctx* ctx, const uint8_t* iv);
+void 		encrypt_payload_ctx(cmd_struct_t *cmd, aes128_ctx* ctx, const ccm_session_t *ses);
+uint8_t 	decrypt_payload_ctx(cmd_struct_t *cmd, aes128_ctx* ctx, const ccm_session_t *ses);
+void 		encrypt_payload(cmd_struct_t *cmd, uint8_t* key, const ccm_session_t *ses);
+uint8_t 	decrypt_payload(cmd_struct_t *cmd, uint8_t* key, const ccm_session_t *ses);
+uint8_t		compact_arg_len(const cmd_struct_t *cmd);
+uint8_t		make_compact_frame(uint8_t *buf, const cmd_struct_t *cmd, uint8_t arg_len, uint8_t* key, const ccm_session_t *ses, uint8_t encryption_en);
+uint8_t		parse_compact_frame(cmd_struct_t *cmd, uint8_t *buf, uint16_t len, uint8_t* key, const ccm_session_t *ses, uint8_t encryption_en);
+#if AES_BATCH
+void 		encrypt_payload_batch(cmd_struct_t *cmd, const aes128_ctx* const* ctx, const ccm_session_t* const* ses, uint16_t n);
+void 		decrypt_payload_batch(cmd_struct_t *cmd, const aes128_ctx* const* ctx, const ccm_session_t* const* ses, uint16_t n, uint8_t* ok);
+#endif
+void		seq_window_reset(seq_window_struct_t *w);
+uint8_t		seq_window_check(seq_window_struct_t *w, uint16_t seq);
+void		reply_cache_reset(reply_cache_struct_t *c);
+reply_cache_entry_t*	reply_cache_find(reply_cache_struct_t *c, const cmd_struct_t *req);
+reply_cache_entry_t*	reply_cache_add(reply_cache_struct_t *c, const cmd_struct_t *req);
+void		reply_cache_fill(reply_cache_entry_t *e, const uint8_t *frame, uint8_t len);
+void		sensor_agg_pack(uint8_t *arg, const sensor_agg_t *agg);
+void		sensor_agg_unpack(sensor_agg_t *agg, const uint8_t *arg);
+uint8_t		sensor_delta_pack(uint8_t *arg, const sensor_agg_t *agg, const sensor_agg_t *ref, uint8_t base);
+#ifdef SLS_GATEWAY_SIDE
+void		make_async_ack(cmd_struct_t *ack, const cmd_struct_t *async);
+uint8_t		async_rx_duplicate(async_rx_struct_t *tab, uint8_t size, const uint8_t *node, uint16_t seq);
+uint8_t		sensor_delta_unpack(sensor_agg_t *agg, const sensor_agg_t *ref, const uint8_t *arg);
+#endif
+void    	scramble_data(uint8_t* data_encrypted, uint8_t* data, const uint8_t* key);
+void    	descramble_data(uint8_t* data_decrypted, uint8_t* data_encrypted, const uint8_t* key);
 
 